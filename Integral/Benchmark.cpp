@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Integral.h"
+
+// Scaling benchmark of the integrator: for every Epsilon and every number
+// of threads the integral of the example is computed several times after
+// warmup runs, and the median and percentiles of the time, the speedup
+// and the efficiency are reported. The results may be compared with a
+// stored baseline, a slower median is reported as a regression.
+
+#define DEFAULT_THREADS "1,2,4,8"
+#define DEFAULT_EPSILONS "1e-9,1e-10"
+#define DEFAULT_REPEATS 5
+#define DEFAULT_WARMUP 1
+#define DEFAULT_TOLERANCE 0.1
+
+constexpr auto FunctionToIntegrate = [](auto X) {
+  return Integration::cos(1. / (X - 5));
+};
+
+struct BenchmarkConfig {
+  std::vector<unsigned> Threads;
+  std::vector<double> Epsilons;
+  unsigned Repeats = DEFAULT_REPEATS;
+  unsigned Warmup = DEFAULT_WARMUP;
+  Integration::IntegralOptions Options;
+  bool isBatched = false;
+  Integration::ThreadPlacement Placement = Integration::ThreadPlacement::None;
+  std::string CsvFile;
+  std::string JsonFile;
+  std::string BaselineFile;
+  // Allowed relative slowdown of the median against the baseline.
+  double Tolerance = DEFAULT_TOLERANCE;
+};
+
+struct BenchmarkPoint {
+  double Epsilon;
+  unsigned Threads;
+  unsigned Repeats;
+  double MedianMs;
+  double P10Ms;
+  double P90Ms;
+  double MinMs;
+  double Speedup;
+  double Efficiency;
+  double Result;
+};
+
+//----------------------------------Arguments----------------------------------
+
+template <typename ValueTy>
+std::vector<ValueTy> parseList(const std::string &List) {
+  std::vector<ValueTy> Values;
+  std::stringstream Stream{List};
+  std::string Item;
+  while (std::getline(Stream, Item, ',')) {
+    std::stringstream ItemStream{Item};
+    ValueTy Value;
+    if (!(ItemStream >> Value))
+      throw std::logic_error("Wrong value \"" + Item + "\" in list " + List);
+    Values.push_back(Value);
+  }
+  if (Values.empty())
+    throw std::logic_error("Empty list of values");
+  return Values;
+}
+
+void printUsage() {
+  std::cout
+      << "Usage: ./integralBench [options]\n"
+         "  --threads 1,2,4,8      numbers of threads\n"
+         "  --epsilons 1e-9,1e-10  accuracies\n"
+         "  --repeats N            measured runs of every point\n"
+         "  --warmup N             runs before the measured ones\n"
+         "  --rule NAME            trapezoid, simpson or gk15\n"
+         "  --simd                 batched evaluation of the integrand\n"
+         "  --exact                reproducible summation\n"
+         "  --global               global error control\n"
+         "  --placement NAME       none, compact or scatter pinning\n"
+         "  --csv FILE, --json FILE  where to write the results\n"
+         "  --baseline FILE        CSV of an earlier run to compare with\n"
+         "  --tolerance X          allowed relative slowdown, 0.1 = 10%\n";
+}
+
+BenchmarkConfig parseArguments(int Argc, const char **Argv) {
+  BenchmarkConfig Config;
+  Config.Threads = parseList<unsigned>(DEFAULT_THREADS);
+  Config.Epsilons = parseList<double>(DEFAULT_EPSILONS);
+  for (auto Idx = 1; Idx < Argc; ++Idx) {
+    std::string Arg = Argv[Idx];
+    auto getValue = [&]() -> std::string {
+      if (Idx + 1 >= Argc)
+        throw std::logic_error("Option " + Arg + " needs a value!");
+      return Argv[++Idx];
+    };
+    if (Arg == "--threads")
+      Config.Threads = parseList<unsigned>(getValue());
+    else if (Arg == "--epsilons")
+      Config.Epsilons = parseList<double>(getValue());
+    else if (Arg == "--repeats")
+      Config.Repeats = std::stoul(getValue());
+    else if (Arg == "--warmup")
+      Config.Warmup = std::stoul(getValue());
+    else if (Arg == "--rule")
+      Config.Options.Rule = Integration::getQuadratureRule(getValue());
+    else if (Arg == "--simd")
+      Config.isBatched = true;
+    else if (Arg == "--exact")
+      Config.Options.isReproducible = true;
+    else if (Arg == "--global")
+      Config.Options.isGlobalError = true;
+    else if (Arg == "--placement")
+      Config.Placement = Integration::getThreadPlacement(getValue());
+    else if (Arg == "--csv")
+      Config.CsvFile = getValue();
+    else if (Arg == "--json")
+      Config.JsonFile = getValue();
+    else if (Arg == "--baseline")
+      Config.BaselineFile = getValue();
+    else if (Arg == "--tolerance")
+      Config.Tolerance = std::stod(getValue());
+    else if (Arg == "--help") {
+      printUsage();
+      std::exit(0);
+    } else
+      throw std::logic_error("Unknown option " + Arg);
+  }
+  if (Config.Repeats == 0)
+    throw std::logic_error("Number of repeats must be positive!");
+  if (std::count(Config.Threads.begin(), Config.Threads.end(), 0))
+    throw std::logic_error("Number of threads must be positive!");
+  return Config;
+}
+
+//---------------------------------Measurements--------------------------------
+
+// Percentile of sorted values with linear interpolation.
+double getPercentile(const std::vector<double> &Sorted, double Percent) {
+  double Position = Percent / 100 * (Sorted.size() - 1);
+  auto Lower = static_cast<std::size_t>(Position);
+  auto Upper = std::min(Lower + 1, Sorted.size() - 1);
+  return Sorted[Lower] + (Position - Lower) * (Sorted[Upper] - Sorted[Lower]);
+}
+
+BenchmarkPoint measure(const BenchmarkConfig &Config, unsigned CountThreads,
+                       double Epsilon) {
+  constexpr double Start = 0.005;
+  constexpr double End = 4.995;
+  // Threads are created before the measurements, as in a long-lived
+  // application.
+  Integration::Integrator Engine{CountThreads, /* isStatsEnabled */ false,
+                                 Config.Placement};
+  auto integrate = [&] {
+    if (Config.isBatched)
+      return Engine.integrate(Integration::vectorized(FunctionToIntegrate),
+                              Start, End, Epsilon, Config.Options);
+    return Engine.integrate(FunctionToIntegrate, Start, End, Epsilon,
+                            Config.Options);
+  };
+
+  for (auto Run = 0u; Run < Config.Warmup; ++Run)
+    integrate();
+
+  std::vector<double> Times;
+  double Result = 0;
+  for (auto Run = 0u; Run < Config.Repeats; ++Run) {
+    auto StartTime = std::chrono::steady_clock::now();
+    Result = integrate();
+    auto StopTime = std::chrono::steady_clock::now();
+    Times.push_back(
+        std::chrono::duration<double, std::milli>(StopTime - StartTime)
+            .count());
+  }
+  std::sort(Times.begin(), Times.end());
+  return {Epsilon,
+          CountThreads,
+          Config.Repeats,
+          getPercentile(Times, 50),
+          getPercentile(Times, 10),
+          getPercentile(Times, 90),
+          Times.front(),
+          0,
+          0,
+          Result};
+}
+
+// Speedup against the smallest number of threads of the same Epsilon.
+void computeSpeedup(std::vector<BenchmarkPoint> &Points) {
+  for (auto &Point : Points) {
+    const BenchmarkPoint *Reference = nullptr;
+    for (auto &Other : Points)
+      if (Other.Epsilon == Point.Epsilon &&
+          (!Reference || Other.Threads < Reference->Threads))
+        Reference = &Other;
+    Point.Speedup = Reference->MedianMs / Point.MedianMs *
+                    Reference->Threads;
+    Point.Efficiency = Point.Speedup / Point.Threads;
+  }
+}
+
+//------------------------------------Output-----------------------------------
+
+#define CSV_HEADER                                                             \
+  "epsilon,threads,repeats,median_ms,p10_ms,p90_ms,min_ms,speedup,"            \
+  "efficiency,result"
+
+void writeCsv(std::ostream &Out, const std::vector<BenchmarkPoint> &Points) {
+  Out << CSV_HEADER << "\n" << std::setprecision(12);
+  for (auto &Point : Points)
+    Out << Point.Epsilon << "," << Point.Threads << "," << Point.Repeats << ","
+        << Point.MedianMs << "," << Point.P10Ms << "," << Point.P90Ms << ","
+        << Point.MinMs << "," << Point.Speedup << "," << Point.Efficiency
+        << "," << Point.Result << "\n";
+}
+
+void writeJson(std::ostream &Out, const BenchmarkConfig &Config,
+               const std::vector<BenchmarkPoint> &Points) {
+  Out << std::setprecision(12) << "{\n  \"hardware_threads\": "
+      << std::thread::hardware_concurrency()
+      << ",\n  \"repeats\": " << Config.Repeats
+      << ",\n  \"warmup\": " << Config.Warmup << ",\n  \"points\": [\n";
+  for (auto Idx = 0u; Idx < Points.size(); ++Idx) {
+    auto &Point = Points[Idx];
+    Out << "    {\"epsilon\": " << Point.Epsilon
+        << ", \"threads\": " << Point.Threads
+        << ", \"median_ms\": " << Point.MedianMs
+        << ", \"p10_ms\": " << Point.P10Ms << ", \"p90_ms\": " << Point.P90Ms
+        << ", \"min_ms\": " << Point.MinMs
+        << ", \"speedup\": " << Point.Speedup
+        << ", \"efficiency\": " << Point.Efficiency
+        << ", \"result\": " << Point.Result << "}"
+        << (Idx + 1 == Points.size() ? "\n" : ",\n");
+  }
+  Out << "  ]\n}\n";
+}
+
+void printTable(const std::vector<BenchmarkPoint> &Points) {
+  std::cout << std::left << std::setw(10) << "Epsilon" << std::setw(9)
+            << "Threads" << std::setw(12) << "Median, ms" << std::setw(20)
+            << "P10 - P90, ms" << std::setw(9) << "Speedup"
+            << "Efficiency\n";
+  for (auto &Point : Points) {
+    std::stringstream Range;
+    Range << std::fixed << std::setprecision(1) << Point.P10Ms << " - "
+          << Point.P90Ms;
+    std::cout << std::left << std::setw(10) << Point.Epsilon << std::setw(9)
+              << Point.Threads << std::setw(12) << std::fixed
+              << std::setprecision(1) << Point.MedianMs << std::setw(20)
+              << Range.str() << std::setw(9) << std::setprecision(2)
+              << Point.Speedup << std::setprecision(2) << Point.Efficiency
+              << "\n"
+              << std::defaultfloat;
+  }
+}
+
+//-----------------------------------Baseline----------------------------------
+
+// Medians of the baseline by (Epsilon, threads).
+std::map<std::pair<double, unsigned>, double>
+readBaseline(const std::string &FileName) {
+  std::ifstream File{FileName};
+  if (!File)
+    throw std::logic_error("Can't open baseline " + FileName);
+  std::map<std::pair<double, unsigned>, double> Medians;
+  std::string Line;
+  std::getline(File, Line);
+  if (Line != CSV_HEADER)
+    throw std::logic_error("Baseline " + FileName +
+                           " is not a CSV of integralBench");
+  while (std::getline(File, Line)) {
+    if (Line.empty())
+      continue;
+    auto Fields = parseList<double>(Line);
+    Medians[{Fields[0], static_cast<unsigned>(Fields[1])}] = Fields[3];
+  }
+  return Medians;
+}
+
+// Returns the number of regressions.
+unsigned compareWithBaseline(const std::vector<BenchmarkPoint> &Points,
+                             const BenchmarkConfig &Config) {
+  auto Baseline = readBaseline(Config.BaselineFile);
+  unsigned Regressions = 0;
+  std::cout << "\nComparison with " << Config.BaselineFile << ":\n";
+  for (auto &Point : Points) {
+    auto It = Baseline.find({Point.Epsilon, Point.Threads});
+    if (It == Baseline.end())
+      continue;
+    double Change = Point.MedianMs / It->second - 1;
+    bool isRegression = Change > Config.Tolerance;
+    Regressions += isRegression;
+    std::cout << "  Epsilon " << Point.Epsilon << ", threads "
+              << Point.Threads << ": " << std::fixed << std::setprecision(1)
+              << It->second << " -> " << Point.MedianMs << " ms ("
+              << std::showpos << Change * 100 << std::noshowpos << "%)"
+              << (isRegression ? "  REGRESSION" : "") << "\n"
+              << std::defaultfloat;
+  }
+  return Regressions;
+}
+
+int main(int Argc, const char **Argv) {
+  try {
+    auto Config = parseArguments(Argc, Argv);
+    std::vector<BenchmarkPoint> Points;
+    for (auto Epsilon : Config.Epsilons)
+      for (auto CountThreads : Config.Threads)
+        Points.push_back(measure(Config, CountThreads, Epsilon));
+    computeSpeedup(Points);
+    printTable(Points);
+
+    if (!Config.CsvFile.empty()) {
+      std::ofstream File{Config.CsvFile};
+      writeCsv(File, Points);
+    }
+    if (!Config.JsonFile.empty()) {
+      std::ofstream File{Config.JsonFile};
+      writeJson(File, Config, Points);
+    }
+    if (!Config.BaselineFile.empty() && compareWithBaseline(Points, Config)) {
+      std::cerr << "Performance regressions found!\n";
+      return 1;
+    }
+  } catch (const std::exception &Ex) {
+    std::cerr << Ex.what() << "\n";
+    return 2;
+  }
+  return 0;
+}
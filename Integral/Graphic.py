@@ -0,0 +1,52 @@
+import csv
+import sys
+
+import matplotlib.pyplot as plt
+
+# Times, speedup and efficiency from the CSV of integralBench,
+# one line for every accuracy.
+
+def read_data(filename):
+    series = {}
+
+    try:
+        with open(filename, 'r') as file:
+            for row in csv.DictReader(file):
+                epsilon = row['epsilon']
+                threads, times, speedups, efficiencies = series.setdefault(
+                    epsilon, ([], [], [], []))
+                threads.append(int(row['threads']))
+                times.append(float(row['median_ms']))
+                speedups.append(float(row['speedup']))
+                efficiencies.append(float(row['efficiency']))
+
+    except FileNotFoundError:
+        print(f"File '{filename}' not found.")
+
+    return series
+
+def plot_data(series, column, ylabel, title, output_file):
+    plt.figure(figsize=(10, 6))
+    for epsilon, values in series.items():
+        plt.plot(values[0], values[column], marker='o',
+                 label=f'Epsilon = {epsilon}')
+    plt.xlabel('Number of threads')
+    plt.ylabel(ylabel)
+    plt.title(title)
+    plt.legend()
+    plt.grid(True)
+    plt.savefig(output_file)
+    plt.close()
+
+
+input_file = sys.argv[1] if len(sys.argv) > 1 else 'Benchmark.csv'
+
+
+series = read_data(input_file)
+
+if series:
+    plot_data(series, 1, 'Time, ms', 'Time (median)', 'Times.png')
+    plot_data(series, 2, 'Speedup', 'Speedup', 'Speedup.png')
+    plot_data(series, 3, 'Efficiency', 'Efficiency', 'Efficiency.png')
+else:
+    print("No valid data to plot.")
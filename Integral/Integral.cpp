@@ -1,36 +1,51 @@
-#include <algorithm>
+#include <array>
 #include <chrono>
 #include <cmath>
-#include <future>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <mutex>
+#include <string>
 #include <thread>
-#include <vector>
 
-#define COUNT_TASKS_TO_MOVE_IN_GLOBAL 20
-#define PRICISION_FOR_RESULT 11
-
-struct IntegralTask {
-  bool isTask = true;
-  double Start;
-  double End;
-  double PartOfIntegral;
+#include "Integral.h"
 
-  IntegralTask() {}
-  IntegralTask(bool isTask) : isTask(isTask) {}
-  IntegralTask(double Start, double End, double PartOfIntegral)
-      : Start(Start), End(End), PartOfIntegral(PartOfIntegral) {}
+#define PRICISION_FOR_RESULT 11
+#define STATS_FILE "IntegralStats.json"
+#define PROGRESS_PERIOD_MS 100
+
+// A lambda rather than a function, so that its type names the integrand
+// and the engine inlines it into the splitting loop. It is generic, so
+// the same body is used in the batched SIMD mode.
+constexpr auto FunctionToIntegrate = [](auto X) {
+  return Integration::cos(1. / (X - 5));
 };
 
-constexpr double FunctionToIntegrate(double X) {
-  return std::cos(1. / (X - 5));
+// Two integrands with a common subexpression, integrated in one pass.
+constexpr auto FunctionsToIntegrate = [](double X) {
+  double Arg = 1. / (X - 5);
+  return std::array<double, 2>{std::cos(Arg), std::sin(Arg)};
 };
 
-double integrateTasks(unsigned CountThreads, double Epsilon,
-                      std::mutex &TasksMtx, std::mutex &isThereTasks,
-                      std::vector<IntegralTask> &Tasks, unsigned &ThreadsExists,
-                      unsigned &MaxThreads);
+// Tells why the integral with the global error control or by tanh-sinh
+// quadrature stopped before Epsilon was reached.
+static void printStopReason(const Integration::IntegralEstimate &Estimate) {
+  auto Precision = std::cout.precision();
+  switch (Estimate.Reason) {
+  case Integration::StopReason::Deadline:
+    std::cout << "Stopped by the deadline";
+    break;
+  case Integration::StopReason::Limit:
+    std::cout << "Stopped by the limit of refinement";
+    break;
+  case Integration::StopReason::NonFinite:
+    std::cout << "Stopped by an infinity or a NaN of the function";
+    break;
+  default:
+    return;
+  }
+  std::cout << ", error: " << std::setprecision(2) << Estimate.Error << "\n";
+  std::cout.precision(Precision);
+}
 
 int main(int Argc, const char **Argv) {
   try {
@@ -41,49 +56,91 @@ int main(int Argc, const char **Argv) {
 
     unsigned CountThreads = std::atoll(Argv[1]);
     double Epsilon = std::atof(Argv[2]);
+    // The rest of the arguments in any order: a quadrature rule, "simd"
+    // for the batched mode, "exact" for the reproducible sum, "vector"
+    // for the vector-valued integrand, "global" for the global error
+    // control, "deadline=MS" for the progressive integral stopped after
+    // MS milliseconds, "stats" for the counters of the threads written to
+    // STATS_FILE and "compact" or "scatter" for the pinning of the
+    // threads.
+    Integration::IntegralOptions Options;
+    auto Placement = Integration::ThreadPlacement::None;
+    bool isBatched = false;
+    bool isVector = false;
+    bool isStatsEnabled = false;
+    long long DeadlineMs = -1;
+    for (auto Idx = 3; Idx < Argc; ++Idx) {
+      std::string Arg = Argv[Idx];
+      if (Arg == "simd")
+        isBatched = true;
+      else if (Arg == "stats")
+        isStatsEnabled = true;
+      else if (Arg == "vector")
+        isVector = true;
+      else if (Arg == "exact")
+        Options.isReproducible = true;
+      else if (Arg == "global")
+        Options.isGlobalError = true;
+      else if (Arg.rfind("deadline=", 0) == 0)
+        DeadlineMs = std::stoll(Arg.substr(9));
+      else if (Arg == "compact" || Arg == "scatter")
+        Placement = Integration::getThreadPlacement(Arg);
+      else
+        Options.Rule = Integration::getQuadratureRule(Arg);
+    }
     unsigned long HWThreads = std::thread::hardware_concurrency();
 
     if (HWThreads != CountThreads)
       std::cout << "Warning! Hardware threads: " << HWThreads
                 << ", but you choose count threads: " << CountThreads << "\n\n";
 
-    //------------------------------Init_First_Task--------------------------------------
-    std::vector<IntegralTask> Tasks;
     constexpr double Start = 0.005;
     constexpr double End = 4.995;
-    constexpr double PartOfIntegral =
-        (FunctionToIntegrate(End) + FunctionToIntegrate(Start)) *
-        (End - Start) / 2;
-    Tasks.emplace_back(Start, End, PartOfIntegral);
-
-    std::vector<std::future<double>> Results(CountThreads);
-    std::mutex TasksMtx;
-    std::mutex isThereTasks;
+    Integration::Integrator Engine{CountThreads, isStatsEnabled, Placement};
 
-    unsigned ThreadsExists = 0;
-    unsigned MaxThreads = 0;
     //------------------------------Start_Integrate--------------------------------------
 
     auto StartTime = std::chrono::high_resolution_clock::now();
-    for (auto Rank = 0; Rank < CountThreads; ++Rank) {
-      std::packaged_task<double(unsigned, double, std::mutex &, std::mutex &,
-                                std::vector<IntegralTask> &, unsigned &,
-                                unsigned &)>
-          Task{integrateTasks};
-      Results[Rank] = Task.get_future();
-      std::thread Thread{move(Task),
-                         CountThreads,
-                         Epsilon,
-                         std::ref(TasksMtx),
-                         std::ref(isThereTasks),
-                         std::ref(Tasks),
-                         std::ref(ThreadsExists),
-                         std::ref(MaxThreads)};
-      Thread.detach();
-    }
-    double Result = 0;
-    std::for_each(Results.begin(), Results.end(),
-                  [&Result](auto &Elem) { Result += Elem.get(); });
+    std::array<double, 2> Results;
+    if (DeadlineMs >= 0) {
+      if (isVector)
+        throw std::logic_error("Deadline is only for a scalar integrand!");
+      if (isBatched)
+        throw std::logic_error("Deadline is not for the batched mode!");
+      // The estimate is printed while the threads work.
+      auto Precision = std::cout.precision();
+      Integration::StopCondition Stop;
+      Stop.Deadline = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds{DeadlineMs};
+      auto Integral = Engine.submitProgressive(FunctionToIntegrate, Start, End,
+                                               Epsilon, Options, Stop);
+      std::chrono::milliseconds Period{PROGRESS_PERIOD_MS};
+      while (!Integral.waitFor(Period)) {
+        auto Estimate = Integral.getEstimate();
+        std::cout << "Estimate: " << std::setprecision(PRICISION_FOR_RESULT)
+                  << Estimate.Value << " +- " << std::setprecision(2)
+                  << Estimate.Error << "\n";
+      }
+      std::cout.precision(Precision);
+      auto Estimate = Integral.get();
+      Results[0] = Estimate.Value;
+      printStopReason(Estimate);
+    } else if (isVector)
+      Results = Engine.integrate(FunctionsToIntegrate, Start, End, Epsilon,
+                                 Options);
+    else if (isBatched)
+      Results[0] =
+          Engine.integrate(Integration::vectorized(FunctionToIntegrate), Start,
+                           End, Epsilon, Options);
+    else if (Options.isGlobalError ||
+             Options.Rule == Integration::QuadratureRule::TanhSinh) {
+      auto Estimate = Engine.integrateWithError(FunctionToIntegrate, Start, End,
+                                                Epsilon, Options);
+      Results[0] = Estimate.Value;
+      printStopReason(Estimate);
+    } else
+      Results[0] = Engine.integrate(FunctionToIntegrate, Start, End, Epsilon,
+                                    Options);
     auto StopTime = std::chrono::high_resolution_clock::now();
 
     //-------------------------------Stop_Integrate--------------------------------------
@@ -92,96 +149,21 @@ int main(int Argc, const char **Argv) {
                                                                       StartTime)
                     .count();
 
-    std::cout << "Number of using threads: " << MaxThreads << ". Time: " << Time
-              << " millisec.\n";
+    std::cout << "Number of using threads: " << Engine.getMaxThreads()
+              << ". Time: " << Time << " millisec.\n";
     std::cout << "Integral of a function on an interval [" << Start << ", "
               << End << "]: " << std::setprecision(PRICISION_FOR_RESULT)
-              << Result << "\n";
+              << Results[0] << "\n";
+    if (isVector)
+      std::cout << "Integral of the second function: " << Results[1] << "\n";
+
+    if (isStatsEnabled) {
+      std::ofstream StatsFile{STATS_FILE};
+      Engine.writeStats(StatsFile);
+      std::cout << "Statistics of the threads: " << STATS_FILE << "\n";
+    }
   } catch (const std::exception &Ex) {
     std::cerr << Ex.what() << "\n";
   }
   return 0;
 }
-
-double integrateTasks(unsigned CountThreads, double Epsilon,
-                      std::mutex &TasksMtx, std::mutex &isThereTasks,
-                      std::vector<IntegralTask> &Tasks, unsigned &ThreadsExists,
-                      unsigned &MaxThreads) {
-  double CurrResult = 0;
-  IntegralTask Task;
-  while (true) {
-    // Wait until the task appears.
-    isThereTasks.lock();
-    {
-      std::lock_guard<std::mutex> LockMtx{TasksMtx};
-
-      Task = Tasks.back();
-      Tasks.pop_back();
-      if (!Tasks.empty())
-        isThereTasks.unlock();
-      // Finalizing task.
-      if (!Task.isTask)
-        break;
-      ++ThreadsExists;
-      if (ThreadsExists > MaxThreads)
-        MaxThreads = ThreadsExists;
-    }
-
-    double Result = 0;
-    std::vector<IntegralTask> MyTasks;
-    while (true) {
-      double Center = (Task.Start + Task.End) / 2;
-      double FunctionInCenter = FunctionToIntegrate(Center);
-
-      double PartOfIntegralStartCenter =
-          (FunctionInCenter + FunctionToIntegrate(Task.Start)) *
-          (Center - Task.Start) / 2;
-      double PartOfIntegralCenterEnd =
-          (FunctionToIntegrate(Task.End) + FunctionInCenter) *
-          (Task.End - Center) / 2;
-      double BetterPartOfIntegral =
-          PartOfIntegralStartCenter + PartOfIntegralCenterEnd;
-
-      // If we have not achieved the required accuracy,
-      // we will divide the task into two.
-      if (std::abs((BetterPartOfIntegral - Task.PartOfIntegral) /
-                   BetterPartOfIntegral) >= Epsilon) {
-        MyTasks.emplace_back(Task.Start, Center, PartOfIntegralStartCenter);
-        Task.Start = Center;
-        Task.PartOfIntegral = PartOfIntegralCenterEnd;
-      } else {
-        Result += BetterPartOfIntegral;
-
-        if (MyTasks.empty())
-          break;
-        Task = MyTasks.back();
-        MyTasks.pop_back();
-      }
-
-      // If all the threads have calculated their parts,
-      // then we will transfer part of the calculations to them.
-      // This is an element of dynamic processor load balancing.
-      if (MyTasks.size() >= COUNT_TASKS_TO_MOVE_IN_GLOBAL && Tasks.empty()) {
-        std::lock_guard<std::mutex> LockMtx{TasksMtx};
-
-        Tasks.insert(Tasks.end(), std::make_move_iterator(MyTasks.begin()),
-                     std::make_move_iterator(MyTasks.end()));
-        MyTasks.clear();
-        isThereTasks.unlock();
-      }
-    }
-    CurrResult += Result;
-
-    {
-      std::lock_guard<std::mutex> LockMtx{TasksMtx};
-      --ThreadsExists;
-
-      if (ThreadsExists == 0 && Tasks.empty()) {
-        // This tasks finalize calculating.
-        Tasks.insert(Tasks.end(), CountThreads, {/* isTask */ false});
-        isThereTasks.unlock();
-      }
-    }
-  }
-  return CurrResult;
-}
@@ -0,0 +1,152 @@
+#ifndef CUBATURE_RULES_H
+#define CUBATURE_RULES_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#define MAX_CUBATURE_DIMENSION 3
+
+namespace Integration {
+
+// Hyper-rectangle of a cubature task.
+template <unsigned Dimension> struct Box {
+  std::array<double, Dimension> Center;
+  std::array<double, Dimension> HalfWidth;
+
+  double getVolume() const {
+    double Volume = 1;
+    for (auto Width : HalfWidth)
+      Volume *= 2 * Width;
+    return Volume;
+  }
+};
+
+// Result of one refinement step of a box: the estimate of the integral,
+// of its absolute error and the axis along which the box is bisected if
+// the error is too large.
+struct CubatureRefinement {
+  double Value;
+  double Error;
+  unsigned SplitAxis;
+};
+
+// Genz-Malik rule of degree 7 with the embedded rule of degree 5 for the
+// error estimate, 2^D + 2D^2 + 2D + 1 nodes. The fourth differences of
+// the integrand along the axes, computed from the same nodes, tell
+// along which axis it changes most: that axis is split.
+template <unsigned Dimension> struct GenzMalikRule {
+  static_assert(Dimension >= 2 && Dimension <= MAX_CUBATURE_DIMENSION,
+                "Genz-Malik rule is used for 2 and 3 dimensions");
+
+  static constexpr unsigned CountNodes =
+      (1u << Dimension) + 2 * Dimension * Dimension + 2 * Dimension + 1;
+
+  template <typename FuncTy>
+  static CubatureRefinement refine(const FuncTy &Func,
+                                   const Box<Dimension> &Task) {
+    constexpr double Lambda2 = 0.3585685828003180919906451539079374954541;
+    constexpr double Lambda4 = 0.9486832980505137995996680633298155601160;
+    constexpr double Lambda5 = 0.6882472016116852977216287342936235251269;
+    constexpr double D = Dimension;
+    constexpr double Weight1 = (12824. - 9120. * D + 400. * D * D) / 19683.;
+    constexpr double Weight2 = 980. / 6561.;
+    constexpr double Weight3 = (1820. - 400. * D) / 19683.;
+    constexpr double Weight4 = 200. / 19683.;
+    constexpr double Weight5 = 6859. / 19683. / (1u << Dimension);
+    constexpr double Weight1Low = (729. - 950. * D + 50. * D * D) / 729.;
+    constexpr double Weight2Low = 245. / 486.;
+    constexpr double Weight3Low = (265. - 100. * D) / 1458.;
+    constexpr double Weight4Low = 25. / 729.;
+    // (Lambda2 / Lambda4)^2
+    constexpr double DifferenceRatio = 1. / 7.;
+
+    auto Point = Task.Center;
+    double FunctionInCenter = Func(Point);
+
+    // Nodes on the axes and the fourth differences along them.
+    double Sum2 = 0, Sum3 = 0;
+    double MaxDifference = -1;
+    unsigned SplitAxis = 0;
+    for (auto Axis = 0u; Axis < Dimension; ++Axis) {
+      double Step2 = Lambda2 * Task.HalfWidth[Axis];
+      double Step4 = Lambda4 * Task.HalfWidth[Axis];
+      Point[Axis] = Task.Center[Axis] - Step2;
+      double Pair2 = Func(Point);
+      Point[Axis] = Task.Center[Axis] + Step2;
+      Pair2 += Func(Point);
+      Point[Axis] = Task.Center[Axis] - Step4;
+      double Pair3 = Func(Point);
+      Point[Axis] = Task.Center[Axis] + Step4;
+      Pair3 += Func(Point);
+      Point[Axis] = Task.Center[Axis];
+      Sum2 += Pair2;
+      Sum3 += Pair3;
+
+      double Difference =
+          std::abs(Pair2 - 2 * FunctionInCenter -
+                   DifferenceRatio * (Pair3 - 2 * FunctionInCenter));
+      // Of the axes with equal differences the widest one is split.
+      if (Difference > MaxDifference ||
+          (Difference == MaxDifference &&
+           Task.HalfWidth[Axis] > Task.HalfWidth[SplitAxis])) {
+        MaxDifference = Difference;
+        SplitAxis = Axis;
+      }
+    }
+
+    // Nodes on the diagonals of the two-dimensional faces.
+    double Sum4 = 0;
+    for (auto First = 0u; First < Dimension; ++First)
+      for (auto Second = First + 1; Second < Dimension; ++Second)
+        for (auto Signs = 0u; Signs < 4; ++Signs) {
+          double FirstStep = (Signs & 1 ? Lambda4 : -Lambda4);
+          double SecondStep = (Signs & 2 ? Lambda4 : -Lambda4);
+          Point[First] = Task.Center[First] + FirstStep * Task.HalfWidth[First];
+          Point[Second] =
+              Task.Center[Second] + SecondStep * Task.HalfWidth[Second];
+          Sum4 += Func(Point);
+          Point[First] = Task.Center[First];
+          Point[Second] = Task.Center[Second];
+        }
+
+    // Nodes near the corners.
+    double Sum5 = 0;
+    for (auto Signs = 0u; Signs < (1u << Dimension); ++Signs) {
+      for (auto Axis = 0u; Axis < Dimension; ++Axis) {
+        double Step = (Signs >> Axis & 1 ? Lambda5 : -Lambda5);
+        Point[Axis] = Task.Center[Axis] + Step * Task.HalfWidth[Axis];
+      }
+      Sum5 += Func(Point);
+    }
+
+    double Volume = Task.getVolume();
+    double Value = Volume * (Weight1 * FunctionInCenter + Weight2 * Sum2 +
+                             Weight3 * Sum3 + Weight4 * Sum4 + Weight5 * Sum5);
+    double LowValue =
+        Volume * (Weight1Low * FunctionInCenter + Weight2Low * Sum2 +
+                  Weight3Low * Sum3 + Weight4Low * Sum4);
+    return {Value, std::abs(Value - LowValue), SplitAxis};
+  }
+};
+
+// Halves of a box bisected along the axis.
+template <unsigned Dimension>
+Box<Dimension> getLowerHalf(const Box<Dimension> &Task, unsigned Axis) {
+  auto Half = Task;
+  Half.HalfWidth[Axis] /= 2;
+  Half.Center[Axis] -= Half.HalfWidth[Axis];
+  return Half;
+}
+
+template <unsigned Dimension>
+Box<Dimension> getUpperHalf(const Box<Dimension> &Task, unsigned Axis) {
+  auto Half = Task;
+  Half.HalfWidth[Axis] /= 2;
+  Half.Center[Axis] += Half.HalfWidth[Axis];
+  return Half;
+}
+
+} // namespace Integration
+
+#endif // CUBATURE_RULES_H
@@ -0,0 +1,144 @@
+#ifndef EXACT_SUM_H
+#define EXACT_SUM_H
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+namespace Integration {
+
+// Exact sum of doubles (a superaccumulator). Every double is an integer
+// multiple of 2^-1074, so the sum is kept as a fixed-point integer split
+// into 32-bit limbs. Limbs are int64_t: carries are propagated lazily,
+// only when a limb comes close to overflow.
+//
+// Addition of integers is associative, so the result does not depend on
+// the order of additions and merges, that is on the number of threads
+// and on the scheduling. The conversion back to double is done from the
+// normalized limbs in a fixed order, which makes it a function of the
+// exact sum only.
+class ExactSum {
+  static constexpr int LimbBits = 32;
+  // Bits from 2^-1074 up to 2^1024 and some more for the carries.
+  static constexpr int CountLimbs = 68;
+  static constexpr std::uint64_t LimbMask = (1ull << LimbBits) - 1;
+  static constexpr std::int64_t LimbLimit = 1ll << 62;
+  // Mantissas have 53 bits, so 2^10 of them fit in a signed 64-bit sum.
+  static constexpr unsigned MaxCachedAdds = 1u << 10;
+
+  std::array<std::int64_t, CountLimbs> Limbs{};
+  // Sum of the mantissas of the last addends that had the same exponent.
+  // Neighbouring parts of an integral usually have close values, so most
+  // additions end here and the limbs are updated much more rarely.
+  std::int64_t CachedSum = 0;
+  int CachedPosition = 0;
+  unsigned CountCached = 0;
+  // Infinities and NaNs, their sum does not depend on the order either.
+  double NonFinite = 0;
+
+public:
+  void add(double Val) {
+    auto Bits = std::bit_cast<std::uint64_t>(Val);
+    int Exponent = (Bits >> 52) & 0x7FF;
+    std::uint64_t Mantissa = Bits & ((1ull << 52) - 1);
+    if (Exponent == 0x7FF) {
+      NonFinite += Val;
+      return;
+    }
+    if (Exponent == 0) {
+      if (Mantissa == 0)
+        return;
+      // Subnormal, the scale is the same as for the smallest exponent.
+      Exponent = 1;
+    } else {
+      Mantissa |= 1ull << 52;
+    }
+
+    // Val = +-Mantissa * 2^(Position - 1074).
+    int Position = Exponent - 1;
+    auto Sign = -static_cast<std::int64_t>(Bits >> 63);
+    auto Signed = (static_cast<std::int64_t>(Mantissa) ^ Sign) - Sign;
+    if (Position != CachedPosition || CountCached == MaxCachedAdds) {
+      flush();
+      CachedPosition = Position;
+    }
+    CachedSum += Signed;
+    ++CountCached;
+  }
+
+  void merge(ExactSum &Rhs) {
+    flush();
+    Rhs.flush();
+    for (auto Idx = 0; Idx < CountLimbs; ++Idx)
+      Limbs[Idx] += Rhs.Limbs[Idx];
+    NonFinite += Rhs.NonFinite;
+    normalize();
+  }
+
+  // The sum rounded to double. The error is a few units in the last
+  // place at most, and it is the same for every order of additions.
+  double get() {
+    if (NonFinite != 0 || std::isnan(NonFinite))
+      return NonFinite;
+    flush();
+    normalize();
+    auto Magnitude = Limbs;
+    double Sign = 1;
+    if (Magnitude[CountLimbs - 1] < 0) {
+      Sign = -1;
+      for (auto &Limb : Magnitude)
+        Limb = -Limb;
+      propagateCarries(Magnitude);
+    }
+    // From the least significant limb, so that the small limbs are
+    // rounded into the large ones only once.
+    double Res = 0;
+    for (auto Idx = 0; Idx < CountLimbs; ++Idx)
+      if (Magnitude[Idx])
+        Res += std::ldexp(static_cast<double>(Magnitude[Idx]),
+                          Idx * LimbBits - 1074);
+    return Sign * Res;
+  }
+
+private:
+  // Move the cached sum to the limbs. Its absolute value is less than
+  // 2^63, shifted it spans three limbs, and every limb gets less than
+  // 2^32, so the limbs below the limit never overflow.
+  void flush() {
+    if (CountCached == 0)
+      return;
+    int Idx = CachedPosition / LimbBits;
+    auto Sign = CachedSum >> 63;
+    auto Magnitude = static_cast<unsigned __int128>((CachedSum ^ Sign) - Sign)
+                     << (CachedPosition % LimbBits);
+    bool isNearOverflow = false;
+    for (auto Part = 0; Part < 3; ++Part) {
+      auto Limb = static_cast<std::int64_t>(
+          (Magnitude >> (Part * LimbBits)) & LimbMask);
+      Limbs[Idx + Part] += (Limb ^ Sign) - Sign;
+      isNearOverflow |= Limbs[Idx + Part] >= LimbLimit ||
+                        Limbs[Idx + Part] <= -LimbLimit;
+    }
+    if (isNearOverflow)
+      normalize();
+    CachedSum = 0;
+    CountCached = 0;
+  }
+
+  // Canonical form: every limb except the last one is in [0, 2^32), the
+  // last one holds the sign.
+  static void propagateCarries(std::array<std::int64_t, CountLimbs> &Limbs) {
+    for (auto Idx = 0; Idx < CountLimbs - 1; ++Idx) {
+      std::int64_t Carry = Limbs[Idx] >> LimbBits;
+      Limbs[Idx] -= Carry * (1ll << LimbBits);
+      Limbs[Idx + 1] += Carry;
+    }
+  }
+
+  void normalize() { propagateCarries(Limbs); }
+};
+
+} // namespace Integration
+
+#endif // EXACT_SUM_H
@@ -0,0 +1,1557 @@
+#ifndef INTEGRAL_H
+#define INTEGRAL_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "CubatureRules.h"
+#include "ExactSum.h"
+#include "IntegralProgress.h"
+#include "IntegratorStats.h"
+#include "QuadratureRules.h"
+#include "RangeTransforms.h"
+#include "SimdMath.h"
+#include "Topology.h"
+#include "WorkStealingDeque.h"
+
+#define SPIN_ROUNDS_BEFORE_SLEEP 256
+// Levels of the double exponential quadrature: the step in T is halved
+// at every level, a level is split into chunks of this many nodes.
+#define TANH_SINH_MIN_LEVEL 3
+#define TANH_SINH_MAX_LEVEL 12
+#define TANH_SINH_CHUNK_NODES 64
+// Global error control: the intervals with the largest errors split in
+// one round, in chunks of this many intervals, and the default limits.
+#define GLOBAL_ROUND_INTERVALS 256
+#define GLOBAL_CHUNK_INTERVALS 32
+#define GLOBAL_MAX_INTERVALS (1u << 16)
+#define GLOBAL_MAX_DEPTH 52
+
+namespace Integration {
+
+class Integrator;
+class IntegralJobBase;
+
+// A task that other threads may steal: the interval and its job, or
+// the box if the job is a cubature.
+struct IntegralTask {
+  IntegralJobBase *Job;
+  union {
+    Interval Range;
+    // Centers of the box, then its half-widths.
+    double Box[2 * MAX_CUBATURE_DIMENSION];
+    // Index of a chunk of the jobs that split a round of work into chunks
+    // themselves.
+    unsigned Chunk;
+  };
+
+  IntegralTask() {}
+  IntegralTask(IntegralJobBase *Job, const Interval &Range)
+      : Job(Job), Range(Range) {}
+  IntegralTask(IntegralJobBase *Job, unsigned Chunk) : Job(Job), Chunk(Chunk) {}
+  template <unsigned Dimension>
+  IntegralTask(IntegralJobBase *Job, const Integration::Box<Dimension> &Range)
+      : Job(Job) {
+    std::copy(Range.Center.begin(), Range.Center.end(), Box);
+    std::copy(Range.HalfWidth.begin(), Range.HalfWidth.end(), Box + Dimension);
+  }
+
+  template <unsigned Dimension> Integration::Box<Dimension> getBox() const {
+    Integration::Box<Dimension> Range;
+    std::copy(Box, Box + Dimension, Range.Center.begin());
+    std::copy(Box + Dimension, Box + 2 * Dimension, Range.HalfWidth.begin());
+    return Range;
+  }
+};
+
+// Depth-first stack of postponed tasks whose oldest entry may be taken
+// for publishing. Taken entries are skipped by an index instead of being
+// erased one by one, so the storage is reused.
+template <typename T> class TaskStack {
+  std::vector<T> Items;
+  std::size_t Oldest = 0;
+
+public:
+  bool empty() const { return Oldest == Items.size(); }
+  std::size_t size() const { return Items.size() - Oldest; }
+  void clear() {
+    Items.clear();
+    Oldest = 0;
+  }
+
+  void push(const T &Item) { Items.push_back(Item); }
+
+  T pop() {
+    T Item = Items.back();
+    Items.pop_back();
+    if (empty())
+      clear();
+    return Item;
+  }
+
+  T popOldest() {
+    T Item = Items[Oldest++];
+    // Taken entries are dropped once they are the majority, so the erase
+    // costs O(1) per publish on average
+    if (2 * Oldest >= Items.size()) {
+      Items.erase(Items.begin(), Items.begin() + Oldest);
+      Oldest = 0;
+    }
+    return Item;
+  }
+
+  // Moves the Count newest entries to Out, the newest one last.
+  void popNewest(std::size_t Count, T *Out) {
+    std::copy(Items.end() - Count, Items.end(), Out);
+    Items.resize(Items.size() - Count);
+    if (empty())
+      clear();
+  }
+};
+
+struct alignas(64) WorkerState {
+  // Tasks that other threads may steal.
+  WorkStealingDeque<IntegralTask> Tasks;
+  // Depth-first stack of the task being refined, only the owner uses it.
+  // All its intervals belong to the job of that task.
+  TaskStack<Interval> MyTasks;
+  std::atomic<bool> isUsed = false;
+  // Counters of the thread, collected if the Integrator is asked to.
+  bool isStatsEnabled = false;
+  WorkerStats Stats;
+  // Processor of the thread and the order in which it robs the others.
+  WorkerPlacement Placement;
+
+  StatCounter *getCounter(StatCounter WorkerStats::*Counter) {
+    return isStatsEnabled ? &(Stats.*Counter) : nullptr;
+  }
+
+  void count(StatCounter WorkerStats::*Counter, std::uint64_t Delta = 1) {
+    if (isStatsEnabled)
+      (Stats.*Counter).add(Delta);
+  }
+
+  // Account the refinement steps of a task.
+  void countWork(std::uint64_t Steps, std::uint64_t Splits,
+                 std::uint64_t Evaluations) {
+    count(&WorkerStats::Steps, Steps);
+    count(&WorkerStats::Splits, Splits);
+    count(&WorkerStats::Evaluations, Evaluations);
+  }
+};
+
+struct IntegralOptions {
+  QuadratureRule Rule = QuadratureRule::Trapezoid;
+  // Sum the parts of the integral exactly: the result is then the same
+  // bit for bit for any number of threads and any order of the tasks.
+  bool isReproducible = false;
+  // Refine the intervals with the largest errors first, until the sum of
+  // the errors of all the intervals is less than Epsilon relative to the
+  // integral, see GlobalErrorJob. The number of live intervals and the
+  // number of halvings of the range are limited then.
+  bool isGlobalError = false;
+  std::size_t MaxIntervals = GLOBAL_MAX_INTERVALS;
+  unsigned MaxDepth = GLOBAL_MAX_DEPTH;
+
+  IntegralOptions() {}
+  IntegralOptions(QuadratureRule Rule) : Rule(Rule) {}
+};
+
+// One (integrand, interval, epsilon) problem of a batch.
+template <typename FuncTy> struct IntegralProblem {
+  FuncTy Func;
+  double Start;
+  double End;
+  double Epsilon;
+  IntegralOptions Options = {};
+};
+
+// A submitted integral. Its tasks are spread over the deques of all
+// threads together with the tasks of other jobs. The job counts its
+// tasks that are in deques or in work and completes its future when
+// the last of them is finished.
+class IntegralJobBase {
+protected:
+  double Epsilon;
+  bool isReproducible;
+  std::atomic<std::size_t> Pending = 1;
+  std::atomic<bool> isAborted = false;
+  std::mutex ExceptionMtx;
+  std::exception_ptr Exception;
+
+public:
+  IntegralJobBase(double Epsilon, bool isReproducible)
+      : Epsilon(Epsilon), isReproducible(isReproducible) {}
+  virtual ~IntegralJobBase() = default;
+
+  bool isFailed() const { return isAborted.load(std::memory_order_relaxed); }
+
+  // Refine the task down to the required accuracy.
+  virtual void processTask(IntegralTask Task, WorkerState &Worker,
+                           Integrator &Pool) = 0;
+
+  void fail(std::exception_ptr Ex) {
+    std::lock_guard<std::mutex> LockMtx{ExceptionMtx};
+    if (!Exception)
+      Exception = Ex;
+    isAborted = true;
+  }
+
+  // Account a task handed to a deque.
+  void addTask() { Pending.fetch_add(1, std::memory_order_relaxed); }
+
+  // Account a finished task, its part of the result must be already
+  // added. The last one completes the future and destroys the job.
+  void finishTask() {
+    if (Pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+      return;
+    complete();
+    delete this;
+  }
+
+protected:
+  // Set the result or the exception to the future.
+  virtual void complete() = 0;
+};
+
+template <typename FuncTy> class IntegralJob final : public IntegralJobBase {
+  FuncTy Func;
+  QuadratureRule Rule;
+  std::atomic<double> Result = 0;
+  // Reproducible jobs sum the parts of the integral here instead of in
+  // Result: the sum is exact, so its order does not matter.
+  std::mutex SumMtx;
+  ExactSum Sum;
+  std::promise<double> Promise;
+
+public:
+  IntegralJob(FuncTy Func, double Epsilon, const IntegralOptions &Options)
+      : IntegralJobBase(Epsilon, Options.isReproducible), Func(std::move(Func)),
+        Rule(Options.Rule) {}
+
+  std::future<double> getFuture() { return Promise.get_future(); }
+
+  // The end values are computed by a thread of the pool, so that
+  // the exceptions of the integrand always come through the future.
+  IntegralTask getFirstTask(double Start, double End) {
+    constexpr auto NaN = std::numeric_limits<double>::quiet_NaN();
+    return {this, {Start, End, NaN, NaN, NaN}};
+  }
+
+  void processTask(IntegralTask Task, WorkerState &Worker,
+                   Integrator &Pool) override;
+
+private:
+  template <typename RuleTy>
+  void refineTask(IntegralTask Task, WorkerState &Worker, Integrator &Pool);
+  template <typename RuleTy>
+  void refineTasksBatched(IntegralTask Task, WorkerState &Worker,
+                          Integrator &Pool);
+
+  // The parts of the integral of one task: a plain sum, or an exact one
+  // for reproducible jobs.
+  struct PartialResult {
+    double Sum = 0;
+    ExactSum Exact;
+  };
+
+  void addToResult(PartialResult &Result, double Value) const {
+    if (isReproducible)
+      Result.Exact.add(Value);
+    else
+      Result.Sum += Value;
+  }
+
+  void finishTask(PartialResult &Part, WorkerState &Worker) {
+    if (isReproducible) {
+      auto Lock = lockCounting(
+          SumMtx, Worker.getCounter(&WorkerStats::ResultLockWait));
+      Sum.merge(Part.Exact);
+    } else if (Part.Sum != 0) {
+      Result.fetch_add(Part.Sum, std::memory_order_relaxed);
+    }
+    IntegralJobBase::finishTask();
+  }
+
+  void complete() override {
+    if (Exception)
+      Promise.set_exception(Exception);
+    else if (isReproducible)
+      Promise.set_value(Sum.get());
+    else
+      Promise.set_value(Result.load(std::memory_order_relaxed));
+  }
+
+  // Evaluates the end and center values the rule uses if the task came
+  // without them. Returns the number of evaluations.
+  template <typename RuleTy> unsigned evaluateEnds(Interval &Task) const {
+    unsigned Evaluations = 0;
+    if (RuleTy::UsesEnds && std::isnan(Task.FunctionInStart)) {
+      Task.FunctionInStart = Func(Task.Start);
+      Task.FunctionInEnd = Func(Task.End);
+      Evaluations += 2;
+    }
+    if (RuleTy::UsesCenter && std::isnan(Task.FunctionInCenter)) {
+      Task.FunctionInCenter = Func((Task.Start + Task.End) / 2);
+      ++Evaluations;
+    }
+    return Evaluations;
+  }
+};
+
+// Integral of a vector-valued integrand, which returns
+// std::array<double, CountComponents>: one adaptive pass computes the
+// integrals of all the components. An interval is split while the
+// largest error of the components relative to the largest absolute value
+// of their integrals on it is not less than Epsilon.
+template <typename FuncTy, std::size_t CountComponents>
+class VectorIntegralJob final : public IntegralJobBase {
+  using ValueTy = std::array<double, CountComponents>;
+  using IntervalTy = VectorInterval<CountComponents>;
+
+  FuncTy Func;
+  QuadratureRule Rule;
+  std::mutex ResultMtx;
+  ValueTy Result{};
+  std::array<ExactSum, CountComponents> Sum;
+  std::promise<ValueTy> Promise;
+
+public:
+  VectorIntegralJob(FuncTy Func, double Epsilon,
+                    const IntegralOptions &Options)
+      : IntegralJobBase(Epsilon, Options.isReproducible), Func(std::move(Func)),
+        Rule(Options.Rule) {}
+
+  std::future<ValueTy> getFuture() { return Promise.get_future(); }
+
+  IntegralTask getFirstTask(double Start, double End) {
+    constexpr auto NaN = std::numeric_limits<double>::quiet_NaN();
+    return {this, {Start, End, NaN, NaN, NaN}};
+  }
+
+  void processTask(IntegralTask Task, WorkerState &Worker,
+                   Integrator &Pool) override;
+
+private:
+  template <typename RuleTy>
+  void refineTask(IntegralTask Task, WorkerState &Worker, Integrator &Pool);
+
+  struct PartialResult {
+    ValueTy Sum{};
+    std::array<ExactSum, CountComponents> Exact;
+  };
+
+  void addToResult(PartialResult &Part, const ValueTy &Value) const {
+    for (auto Component = 0u; Component < CountComponents; ++Component)
+      if (isReproducible)
+        Part.Exact[Component].add(Value[Component]);
+      else
+        Part.Sum[Component] += Value[Component];
+  }
+
+  void finishTask(PartialResult &Part, WorkerState &Worker) {
+    {
+      auto Lock = lockCounting(
+          ResultMtx, Worker.getCounter(&WorkerStats::ResultLockWait));
+      for (auto Component = 0u; Component < CountComponents; ++Component)
+        if (isReproducible)
+          Sum[Component].merge(Part.Exact[Component]);
+        else
+          Result[Component] += Part.Sum[Component];
+    }
+    IntegralJobBase::finishTask();
+  }
+
+  void complete() override {
+    if (Exception)
+      return Promise.set_exception(Exception);
+    if (isReproducible)
+      for (auto Component = 0u; Component < CountComponents; ++Component)
+        Result[Component] = Sum[Component].get();
+    Promise.set_value(Result);
+  }
+};
+
+// Value of the integrand and of its integral: double, or std::array for
+// a vector-valued integrand.
+template <typename FuncTy>
+using IntegralValue = std::invoke_result_t<const FuncTy &, double>;
+
+template <typename FuncTy, typename ValueTy = IntegralValue<FuncTy>>
+struct JobSelector {
+  using Type = IntegralJob<FuncTy>;
+};
+
+template <typename FuncTy, std::size_t CountComponents>
+struct JobSelector<FuncTy, std::array<double, CountComponents>> {
+  using Type = VectorIntegralJob<FuncTy, CountComponents>;
+};
+
+// Integral over a box of a function of Dimension variables, which takes
+// std::array<double, Dimension>. Boxes are refined with the Genz-Malik
+// rule and bisected along the axis where the integrand changes most,
+// until the error estimate relative to the value on the box is less
+// than Epsilon. The boxes are balanced across the threads just like the
+// intervals of one-dimensional integrals.
+template <typename FuncTy, unsigned Dimension>
+class CubatureJob final : public IntegralJobBase {
+  FuncTy Func;
+  std::atomic<double> Result = 0;
+  std::mutex SumMtx;
+  ExactSum Sum;
+  std::promise<double> Promise;
+
+public:
+  CubatureJob(FuncTy Func, double Epsilon, const IntegralOptions &Options)
+      : IntegralJobBase(Epsilon, Options.isReproducible),
+        Func(std::move(Func)) {}
+
+  std::future<double> getFuture() { return Promise.get_future(); }
+
+  IntegralTask getFirstTask(const std::array<double, Dimension> &Start,
+                            const std::array<double, Dimension> &End) {
+    Box<Dimension> Range;
+    for (auto Axis = 0u; Axis < Dimension; ++Axis) {
+      Range.Center[Axis] = (Start[Axis] + End[Axis]) / 2;
+      Range.HalfWidth[Axis] = (End[Axis] - Start[Axis]) / 2;
+    }
+    return {this, Range};
+  }
+
+  void processTask(IntegralTask Task, WorkerState &Worker,
+                   Integrator &Pool) override;
+
+private:
+  struct PartialResult {
+    double Sum = 0;
+    ExactSum Exact;
+  };
+
+  void finishTask(PartialResult &Part, WorkerState &Worker) {
+    if (isReproducible) {
+      auto Lock = lockCounting(
+          SumMtx, Worker.getCounter(&WorkerStats::ResultLockWait));
+      Sum.merge(Part.Exact);
+    } else if (Part.Sum != 0) {
+      Result.fetch_add(Part.Sum, std::memory_order_relaxed);
+    }
+    IntegralJobBase::finishTask();
+  }
+
+  void complete() override {
+    if (Exception)
+      Promise.set_exception(Exception);
+    else if (isReproducible)
+      Promise.set_value(Sum.get());
+    else
+      Promise.set_value(Result.load(std::memory_order_relaxed));
+  }
+};
+
+// Integral by the double exponential quadrature: the trapezoid rule in T
+// after the substitution x(T) of DoubleExponentialMap, with the step
+// halved level by level until two levels agree to Epsilon relative to
+// the integral. Every level adds the nodes halfway between the old ones.
+// They are split into chunks, balanced across the threads like the
+// intervals. The thread that finishes the last chunk of a level sums the
+// chunks in their order and starts the next level, so the result does
+// not depend on the number of threads. With Progress the estimate of
+// every level is published there, and the job stops early if the caller
+// asks.
+template <typename FuncTy> class TanhSinhJob final : public IntegralJobBase {
+  FuncTy Func;
+  DoubleExponentialMap Map{0, 1};
+  // The level being computed: its step in T and its nodes
+  // (FirstNode + Idx * NodeStride) * Step for Idx < CountNodes.
+  unsigned Level = 0;
+  double Step = 1;
+  long long FirstNode = 0;
+  unsigned NodeStride = 1;
+  unsigned CountNodes = 0;
+  std::vector<double> ChunkSums;
+  std::atomic<unsigned> LevelPending = 0;
+  // Terms of the first level, they tell where the tails are negligible.
+  std::vector<double> FirstLevelTerms;
+  // Weighted values in all the nodes of the finished levels.
+  double WeightedSum = 0;
+  double Estimate = 0;
+  // Difference between the estimates of the last two levels.
+  double Error = std::numeric_limits<double>::infinity();
+  std::size_t CountAllNodes = 0;
+  std::shared_ptr<IntegralProgress> Progress;
+  StopReason Reason = StopReason::Running;
+  std::promise<double> Promise;
+
+public:
+  TanhSinhJob(FuncTy Func, double Epsilon, const IntegralOptions &Options,
+              std::shared_ptr<IntegralProgress> Progress = nullptr)
+      : IntegralJobBase(Epsilon, Options.isReproducible),
+        Func(std::move(Func)), Progress(std::move(Progress)) {}
+
+  std::future<double> getFuture() { return Promise.get_future(); }
+
+  IntegralTask getFirstTask(double Start, double End) {
+    Map = DoubleExponentialMap{Start, End};
+    startLevel(0);
+    return {this, 0u};
+  }
+
+  void processTask(IntegralTask Task, WorkerState &Worker,
+                   Integrator &Pool) override;
+
+private:
+  // Returns the number of chunks of the level.
+  unsigned startLevel(unsigned NewLevel) {
+    Level = NewLevel;
+    Step = std::ldexp(1., -static_cast<int>(Level));
+    // The first level takes all the integer T, the next ones the odd
+    // multiples of their steps.
+    NodeStride = Level == 0 ? 1 : 2;
+    FirstNode = static_cast<long long>(std::ceil(-Map.TLeft / Step));
+    auto LastNode = static_cast<long long>(std::floor(Map.TRight / Step));
+    if (NodeStride == 2 && FirstNode % 2 == 0)
+      ++FirstNode;
+    CountNodes = (LastNode - FirstNode) / NodeStride + 1;
+    CountAllNodes += CountNodes;
+    unsigned CountChunks =
+        (CountNodes + TANH_SINH_CHUNK_NODES - 1) / TANH_SINH_CHUNK_NODES;
+    ChunkSums.assign(CountChunks, 0);
+    if (Level == 0)
+      FirstLevelTerms.assign(CountNodes, 0);
+    LevelPending.store(CountChunks, std::memory_order_relaxed);
+    return CountChunks;
+  }
+
+  double sumChunk(unsigned Chunk, std::uint64_t &Evaluations) {
+    auto First = Chunk * TANH_SINH_CHUNK_NODES;
+    auto Last = std::min(First + TANH_SINH_CHUNK_NODES, CountNodes);
+    double Sum = 0;
+    for (auto Idx = First; Idx < Last; ++Idx) {
+      double X, Weight;
+      auto Node = FirstNode + static_cast<long long>(Idx) * NodeStride;
+      if (!Map.getNode(Node * Step, X, Weight))
+        continue;
+      double Term = Weight * Func(X);
+      ++Evaluations;
+      if (Level == 0)
+        FirstLevelTerms[Idx] = Term;
+      Sum += Term;
+    }
+    return Sum;
+  }
+
+  // Sum the chunks of the level. Returns true if the job stops.
+  bool finishLevel() {
+    for (auto ChunkSum : ChunkSums)
+      WeightedSum += ChunkSum;
+    double PreviousEstimate = Estimate;
+    Estimate = Step * WeightedSum;
+    if (Level == 0) {
+      truncateTails();
+      return false;
+    }
+    Error = std::abs(Estimate - PreviousEstimate);
+    Reason = getStopReason();
+    if (Reason != StopReason::Running)
+      return true;
+    if (Progress)
+      Progress->setEstimate(getEstimate());
+    return false;
+  }
+
+  StopReason getStopReason() const {
+    if (!std::isfinite(Estimate))
+      return StopReason::NonFinite;
+    if (Level >= TANH_SINH_MIN_LEVEL && Error <= Epsilon * std::abs(Estimate))
+      return StopReason::Converged;
+    if (Level == TANH_SINH_MAX_LEVEL)
+      return StopReason::Limit;
+    if (Progress)
+      return Progress->checkStop(Error);
+    return StopReason::Running;
+  }
+
+  IntegralEstimate getEstimate() const {
+    return {Estimate, Error, CountAllNodes, Reason};
+  }
+
+  // The terms decay double exponentially, so beyond the last integer T
+  // with a noticeable term and the next one the nodes are not needed.
+  void truncateTails() {
+    double Negligible = Epsilon * std::abs(Estimate) / 1024;
+    double NewLeft = 1, NewRight = 1;
+    for (auto Idx = 0u; Idx < CountNodes; ++Idx) {
+      if (!(std::abs(FirstLevelTerms[Idx]) > Negligible))
+        continue;
+      double T = FirstNode + static_cast<long long>(Idx);
+      NewLeft = std::max(NewLeft, -T + 1);
+      NewRight = std::max(NewRight, T + 1);
+    }
+    Map.TLeft = std::min(Map.TLeft, NewLeft);
+    Map.TRight = std::min(Map.TRight, NewRight);
+  }
+
+  void complete() override {
+    if (Exception) {
+      Promise.set_exception(Exception);
+      return;
+    }
+    if (Progress)
+      Progress->setEstimate(getEstimate());
+    Promise.set_value(Estimate);
+  }
+};
+
+// Integral with the global error control, as in QUADPACK QAG: the
+// intervals are kept in a heap by their error estimates, and the worst
+// ones are split until the sum of the errors is less than Epsilon
+// relative to the sum of the values. So the accuracy of the intervals
+// where the integrand is close to zero does not matter by itself, and
+// the memory is bounded: the heap holds at most MaxIntervals intervals,
+// and the intervals halved MaxDepth times are not split any more.
+//
+// The work goes in rounds: up to GLOBAL_ROUND_INTERVALS worst intervals
+// are taken from the heap, and their halves are refined in chunks that
+// are balanced across the threads. The thread that finishes the last
+// chunk puts the halves into the heap in their order and starts the
+// next round, so the result does not depend on the number of threads.
+// With Progress the estimate of every round is published there, and the
+// job stops early if the caller asks.
+template <typename FuncTy>
+class GlobalErrorJob final : public IntegralJobBase {
+  struct RatedInterval {
+    Interval Range;
+    Refinement Step;
+    unsigned Depth;
+
+    bool operator<(const RatedInterval &Rhs) const {
+      return Step.Error < Rhs.Step.Error;
+    }
+  };
+
+  FuncTy Func;
+  QuadratureRule Rule;
+  std::size_t MaxIntervals;
+  unsigned MaxDepth;
+  bool isStarted = false;
+  std::vector<RatedInterval> Heap;
+  double HeapValue = 0;
+  double HeapError = 0;
+  // Intervals of MaxDepth, they are final.
+  double FinalValue = 0;
+  double FinalError = 0;
+  // Intervals split in the current round and their halves.
+  std::vector<RatedInterval> Round;
+  std::vector<RatedInterval> Halves;
+  std::atomic<unsigned> RoundPending = 0;
+  std::shared_ptr<IntegralProgress> Progress;
+  StopReason Reason = StopReason::Running;
+  std::promise<double> Promise;
+
+public:
+  GlobalErrorJob(FuncTy Func, double Epsilon, const IntegralOptions &Options,
+                 std::shared_ptr<IntegralProgress> Progress = nullptr)
+      : IntegralJobBase(Epsilon, Options.isReproducible),
+        Func(std::move(Func)), Rule(Options.Rule),
+        MaxIntervals(std::max<std::size_t>(Options.MaxIntervals, 1)),
+        MaxDepth(Options.MaxDepth), Progress(std::move(Progress)) {}
+
+  std::future<double> getFuture() { return Promise.get_future(); }
+
+  IntegralTask getFirstTask(double Start, double End) {
+    constexpr auto NaN = std::numeric_limits<double>::quiet_NaN();
+    return {this, {Start, End, NaN, NaN, NaN}};
+  }
+
+  void processTask(IntegralTask Task, WorkerState &Worker,
+                   Integrator &Pool) override;
+
+private:
+  template <typename RuleTy>
+  void refineTask(IntegralTask Task, WorkerState &Worker, Integrator &Pool);
+
+  template <typename RuleTy> void splitChunk(unsigned Chunk) {
+    auto First = Chunk * GLOBAL_CHUNK_INTERVALS;
+    auto Last = std::min<std::size_t>(First + GLOBAL_CHUNK_INTERVALS,
+                                      Round.size());
+    for (auto Idx = First; Idx < Last; ++Idx) {
+      auto &Parent = Round[Idx];
+      auto Left = getLeftHalf(Parent.Range, Parent.Step);
+      auto Right = getRightHalf(Parent.Range, Parent.Step);
+      Halves[2 * Idx] = {Left, refine<RuleTy>(Func, Left), Parent.Depth + 1};
+      Halves[2 * Idx + 1] = {Right, refine<RuleTy>(Func, Right),
+                             Parent.Depth + 1};
+    }
+  }
+
+  void addInterval(const RatedInterval &Piece) {
+    if (Piece.Depth >= MaxDepth) {
+      FinalValue += Piece.Step.Value;
+      FinalError += Piece.Step.Error;
+      return;
+    }
+    Heap.push_back(Piece);
+    std::push_heap(Heap.begin(), Heap.end());
+    HeapValue += Piece.Step.Value;
+    HeapError += Piece.Step.Error;
+  }
+
+  bool isAccurate() {
+    auto isEnough = [&] {
+      return HeapError + FinalError <=
+             Epsilon * std::abs(HeapValue + FinalValue);
+    };
+    if (!isEnough())
+      return false;
+    // The running sums are not exact after many subtractions, so the
+    // answer is checked with the sums computed anew.
+    HeapValue = HeapError = 0;
+    for (auto &Piece : Heap) {
+      HeapValue += Piece.Step.Value;
+      HeapError += Piece.Step.Error;
+    }
+    return isEnough();
+  }
+
+  StopReason getStopReason() {
+    // The heap can't order NaN errors.
+    if (!std::isfinite(HeapError + FinalError))
+      return StopReason::NonFinite;
+    if (isAccurate())
+      return StopReason::Converged;
+    if (Heap.empty() || Heap.size() >= MaxIntervals)
+      return StopReason::Limit;
+    if (Progress)
+      return Progress->checkStop(HeapError + FinalError);
+    return StopReason::Running;
+  }
+
+  IntegralEstimate getEstimate(double Value) const {
+    return {Value, HeapError + FinalError, Heap.size(), Reason};
+  }
+
+  // Take the worst intervals for the next round. Returns the number of
+  // its chunks, 0 if the job stops.
+  unsigned startRound() {
+    for (auto &Half : Halves)
+      addInterval(Half);
+    Round.clear();
+    Reason = getStopReason();
+    if (Reason != StopReason::Running)
+      return 0;
+    if (Progress)
+      Progress->setEstimate(getEstimate(HeapValue + FinalValue));
+    // Every split adds one interval to the heap. The intervals are taken
+    // until the errors of the rest fit in the budget: splitting the rest
+    // is not needed yet.
+    auto MaxSplits = std::min<std::size_t>(GLOBAL_ROUND_INTERVALS,
+                                           MaxIntervals - Heap.size());
+    double Budget = Epsilon * std::abs(HeapValue + FinalValue);
+    while (!Heap.empty() && Round.size() < MaxSplits &&
+           HeapError + FinalError > Budget) {
+      std::pop_heap(Heap.begin(), Heap.end());
+      Round.push_back(Heap.back());
+      Heap.pop_back();
+      HeapValue -= Round.back().Step.Value;
+      HeapError -= Round.back().Step.Error;
+    }
+    Halves.resize(2 * Round.size());
+    unsigned CountChunks =
+        (Round.size() + GLOBAL_CHUNK_INTERVALS - 1) / GLOBAL_CHUNK_INTERVALS;
+    RoundPending.store(CountChunks, std::memory_order_relaxed);
+    return CountChunks;
+  }
+
+  void complete() override {
+    if (Exception) {
+      Promise.set_exception(Exception);
+      return;
+    }
+    double Result = FinalValue;
+    for (auto &Piece : Heap)
+      Result += Piece.Step.Value;
+    if (Progress)
+      Progress->setEstimate(getEstimate(Result));
+    Promise.set_value(Result);
+  }
+};
+
+// Persistent threads for adaptive integration. The threads are created
+// once and serve all submitted integrals: the intervals of different
+// jobs share the same deques, so a batch of small integrals is balanced
+// across the threads just like the parts of one big integral.
+class Integrator {
+  std::vector<WorkerState> Workers;
+  std::vector<std::thread> Threads;
+  ThreadPlacement Placement;
+
+  // First tasks of submitted jobs. Only the owner may push into
+  // a deque, so new jobs come to the threads through this queue.
+  std::mutex InboxMtx;
+  std::deque<IntegralTask> Inbox;
+  std::atomic<std::size_t> InboxSize = 0;
+
+  // Threads that find no work for a while sleep until new tasks appear.
+  std::mutex SleepMtx;
+  std::condition_variable WakeUp;
+  std::atomic<unsigned> SleepingThreads = 0;
+  unsigned long long WakeEpoch = 0;
+  bool isStopped = false;
+
+public:
+  // With isStatsEnabled the threads count their work, their waiting and
+  // the time spent on the mutexes, see getStats(). With a placement the
+  // threads are pinned to the processors, and an idle thread robs the
+  // threads sharing its L3 cache first, then those of its socket.
+  explicit Integrator(unsigned CountThreads, bool isStatsEnabled = false,
+                      ThreadPlacement Placement = ThreadPlacement::None)
+      : Workers(CountThreads), Placement(Placement) {
+    if (CountThreads == 0)
+      throw std::logic_error("Number of threads must be positive!");
+    auto Places = placeThreads(CountThreads, Placement);
+    for (auto Rank = 0u; Rank < CountThreads; ++Rank) {
+      Workers[Rank].isStatsEnabled = isStatsEnabled;
+      Workers[Rank].Placement = std::move(Places[Rank]);
+    }
+    for (auto Rank = 0u; Rank < CountThreads; ++Rank) {
+      Threads.emplace_back(&Integrator::workerLoop, this, Rank);
+      auto &Place = Workers[Rank].Placement;
+      if (Placement != ThreadPlacement::None)
+        Place.isPinned = pinThread(Threads.back(), Place.Location.Cpu);
+    }
+  }
+
+  Integrator(const Integrator &) = delete;
+  Integrator &operator=(const Integrator &) = delete;
+
+  // Submitted jobs are finished before the threads are joined.
+  ~Integrator() {
+    {
+      std::lock_guard<std::mutex> LockMtx{SleepMtx};
+      isStopped = true;
+      ++WakeEpoch;
+    }
+    WakeUp.notify_all();
+    for (auto &Thread : Threads)
+      Thread.join();
+  }
+
+  unsigned getCountThreads() const { return Workers.size(); }
+  // Number of threads that have got at least one task.
+  unsigned getMaxThreads() const {
+    return std::count_if(Workers.begin(), Workers.end(), [](const auto &W) {
+      return W.isUsed.load(std::memory_order_relaxed);
+    });
+  }
+
+  // Counters of every thread. The time of a task is added when it is
+  // finished, and the idle time when a thread finds work again.
+  std::vector<WorkerStatsSnapshot> getStats() const {
+    std::vector<WorkerStatsSnapshot> Stats;
+    for (auto &Worker : Workers)
+      Stats.push_back(Worker.Stats.get());
+    return Stats;
+  }
+
+  // Call when no jobs are running.
+  void resetStats() {
+    for (auto &Worker : Workers)
+      Worker.Stats.reset();
+  }
+
+  std::vector<WorkerPlacement> getPlacements() const {
+    std::vector<WorkerPlacement> Places;
+    for (auto &Worker : Workers)
+      Places.push_back(Worker.Placement);
+    return Places;
+  }
+
+  void writeStats(std::ostream &Out) const {
+    writeStatsJson(Out, getStats(), Placement, getPlacements());
+  }
+
+  // Integral of Func on [Start, End] computed with the adaptive
+  // quadrature. An interval is split in two while the error estimate
+  // of the rule relative to the value on the interval is not less than
+  // Epsilon. For the trapezoid rule this is the relative difference
+  // between the one- and two-trapezoid estimates.
+  template <typename FuncTy>
+  std::future<IntegralValue<FuncTy>>
+  submit(FuncTy Func, double Start, double End, double Epsilon,
+         IntegralOptions Options = {}) {
+    std::vector<IntegralProblem<FuncTy>> Batch;
+    Batch.push_back({std::move(Func), Start, End, Epsilon, Options});
+    return std::move(submitBatch(std::move(Batch)).front());
+  }
+
+  template <typename FuncTy>
+  std::vector<std::future<IntegralValue<FuncTy>>>
+  submitBatch(std::vector<IntegralProblem<FuncTy>> Batch) {
+    std::vector<std::future<IntegralValue<FuncTy>>> Results;
+    std::vector<IntegralTask> FirstTasks;
+    Results.reserve(Batch.size());
+    FirstTasks.reserve(Batch.size());
+    for (auto &Problem : Batch) {
+      // Tanh-sinh quadrature maps infinite ranges itself.
+      if (Problem.Options.Rule != QuadratureRule::TanhSinh &&
+          getRangeKind(Problem.Start, Problem.End) != RangeKind::Finite) {
+        auto Func = substituteInfiniteRange(std::move(Problem.Func),
+                                            Problem.Start, Problem.End);
+        auto [Start, End] = Func.getRange();
+        createProblemJob(std::move(Func), Start, End, Problem, FirstTasks,
+                         Results);
+      } else {
+        createProblemJob(std::move(Problem.Func), Problem.Start, Problem.End,
+                         Problem, FirstTasks, Results);
+      }
+    }
+    pushToInbox(FirstTasks);
+    return Results;
+  }
+
+  // Integral of Func over the box [Start, End] of 2 or 3 dimensions.
+  // Options.Rule is not used, boxes are always refined with the
+  // Genz-Malik rule.
+  template <typename FuncTy, std::size_t Dimension>
+  std::future<double> submit(FuncTy Func,
+                             const std::array<double, Dimension> &Start,
+                             const std::array<double, Dimension> &End,
+                             double Epsilon, IntegralOptions Options = {}) {
+    auto Job = std::make_unique<CubatureJob<FuncTy, Dimension>>(
+        std::move(Func), Epsilon, Options);
+    std::vector<IntegralTask> FirstTasks{Job->getFirstTask(Start, End)};
+    auto Result = Job->getFuture();
+    Job.release();
+    pushToInbox(FirstTasks);
+    return Result;
+  }
+
+  // Integral with the global error control or by tanh-sinh quadrature,
+  // whose estimate and error can be polled while the threads work. It
+  // stops when Epsilon is reached, or by the stop condition, or when
+  // cancelled, with the best estimate reached so far.
+  template <typename FuncTy>
+  ProgressiveIntegral submitProgressive(FuncTy Func, double Start,
+                                        double End, double Epsilon,
+                                        IntegralOptions Options = {},
+                                        const StopCondition &Stop = {}) {
+    static_assert(std::is_same_v<IntegralValue<FuncTy>, double>,
+                  "Progressive integrals are only for scalar integrands");
+    auto Progress = std::make_shared<IntegralProgress>(Stop);
+    // Tanh-sinh quadrature maps infinite ranges itself.
+    if (Options.Rule == QuadratureRule::TanhSinh)
+      return {Progress, submitWithProgress<TanhSinhJob>(
+                            std::move(Func), Start, End, Epsilon, Options,
+                            Progress)};
+    Options.isGlobalError = true;
+    if (getRangeKind(Start, End) == RangeKind::Finite)
+      return {Progress, submitWithProgress<GlobalErrorJob>(
+                            std::move(Func), Start, End, Epsilon, Options,
+                            Progress)};
+    auto Substituted = substituteInfiniteRange(std::move(Func), Start, End);
+    auto [NewStart, NewEnd] = Substituted.getRange();
+    return {Progress, submitWithProgress<GlobalErrorJob>(
+                          std::move(Substituted), NewStart, NewEnd, Epsilon,
+                          Options, Progress)};
+  }
+
+  template <typename FuncTy>
+  IntegralValue<FuncTy> integrate(const FuncTy &Func, double Start,
+                                  double End, double Epsilon,
+                                  IntegralOptions Options = {}) {
+    return submit(Func, Start, End, Epsilon, Options).get();
+  }
+
+  template <typename FuncTy, std::size_t Dimension>
+  double integrate(const FuncTy &Func,
+                   const std::array<double, Dimension> &Start,
+                   const std::array<double, Dimension> &End, double Epsilon,
+                   IntegralOptions Options = {}) {
+    return submit(Func, Start, End, Epsilon, Options).get();
+  }
+
+  // Integral with the global error control or by tanh-sinh quadrature
+  // together with its error estimate and the reason it stopped. If
+  // MaxIntervals or MaxDepth, or TANH_SINH_MAX_LEVEL for tanh-sinh, stop
+  // it before Epsilon is reached, Reason is StopReason::Limit, and if the
+  // integrand gives an infinity or a NaN, StopReason::NonFinite.
+  template <typename FuncTy>
+  IntegralEstimate integrateWithError(const FuncTy &Func, double Start,
+                                      double End, double Epsilon,
+                                      IntegralOptions Options = {}) {
+    return submitProgressive(Func, Start, End, Epsilon, Options).get();
+  }
+
+  // Make the task available to other threads. Called by the owner of
+  // the deque only.
+  void publish(WorkerState &Worker, const IntegralTask &Task) {
+    Task.Job->addTask();
+    Worker.Tasks.push(Task);
+    Worker.count(&WorkerStats::Published);
+    wakeUp(/* All */ false, Worker.getCounter(&WorkerStats::SleepLockWait));
+  }
+
+private:
+  template <template <typename> class JobTy, typename FuncTy>
+  std::future<double>
+  submitWithProgress(FuncTy Func, double Start, double End, double Epsilon,
+                     const IntegralOptions &Options,
+                     std::shared_ptr<IntegralProgress> Progress) {
+    auto Job = std::make_unique<JobTy<FuncTy>>(std::move(Func), Epsilon,
+                                               Options, std::move(Progress));
+    std::vector<IntegralTask> FirstTasks{Job->getFirstTask(Start, End)};
+    auto Result = Job->getFuture();
+    Job.release();
+    pushToInbox(FirstTasks);
+    return Result;
+  }
+
+  // The job of the kind the options ask for.
+  template <typename FuncTy, typename ProblemTy, typename ValueTy>
+  static void createProblemJob(FuncTy Func, double Start, double End,
+                        const ProblemTy &Problem,
+                        std::vector<IntegralTask> &FirstTasks,
+                        std::vector<std::future<ValueTy>> &Results) {
+    auto &Options = Problem.Options;
+    if (Options.Rule != QuadratureRule::TanhSinh && !Options.isGlobalError)
+      return createJob<typename JobSelector<FuncTy>::Type>(
+          std::move(Func), Start, End, Problem, FirstTasks, Results);
+    if constexpr (std::is_same_v<ValueTy, double>) {
+      if (Options.Rule == QuadratureRule::TanhSinh)
+        createJob<TanhSinhJob<FuncTy>>(std::move(Func), Start, End, Problem,
+                                       FirstTasks, Results);
+      else
+        createJob<GlobalErrorJob<FuncTy>>(std::move(Func), Start, End,
+                                          Problem, FirstTasks, Results);
+    } else {
+      throw std::logic_error("Tanh-sinh quadrature and global error control "
+                             "are only for scalar integrands");
+    }
+  }
+
+  template <typename JobTy, typename FuncTy, typename ProblemTy,
+            typename ValueTy>
+  static void createJob(FuncTy Func, double Start, double End,
+                        const ProblemTy &Problem,
+                        std::vector<IntegralTask> &FirstTasks,
+                        std::vector<std::future<ValueTy>> &Results) {
+    auto Job = std::make_unique<JobTy>(std::move(Func), Problem.Epsilon,
+                                       Problem.Options);
+    FirstTasks.push_back(Job->getFirstTask(Start, End));
+    Results.push_back(Job->getFuture());
+    Job.release();
+  }
+
+  void pushToInbox(const std::vector<IntegralTask> &FirstTasks) {
+    {
+      std::lock_guard<std::mutex> LockMtx{InboxMtx};
+      Inbox.insert(Inbox.end(), FirstTasks.begin(), FirstTasks.end());
+      InboxSize.store(Inbox.size(), std::memory_order_relaxed);
+    }
+    wakeUp(/* All */ FirstTasks.size() > 1);
+  }
+
+  void wakeUp(bool All, StatCounter *LockWait = nullptr) {
+    // Pairs with the fence in sleep(): either the sleeping thread sees
+    // the new task, or we see that it sleeps.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (SleepingThreads.load(std::memory_order_relaxed) == 0)
+      return;
+    {
+      auto Lock = lockCounting(SleepMtx, LockWait);
+      ++WakeEpoch;
+    }
+    if (All)
+      WakeUp.notify_all();
+    else
+      WakeUp.notify_one();
+  }
+
+  // Returns false if the integrator is stopped and there is no work.
+  bool sleep(WorkerState &Worker) {
+    auto Lock =
+        lockCounting(SleepMtx, Worker.getCounter(&WorkerStats::SleepLockWait));
+    auto SeenEpoch = WakeEpoch;
+    SleepingThreads.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool isWorkLeft = isThereTasks();
+    if (!isWorkLeft && !isStopped) {
+      StatsClock::time_point Start;
+      if (Worker.isStatsEnabled)
+        Start = StatsClock::now();
+      WakeUp.wait(Lock,
+                  [&] { return isStopped || WakeEpoch != SeenEpoch; });
+      Worker.count(&WorkerStats::Sleeps);
+      if (Worker.isStatsEnabled)
+        Worker.Stats.SleepTime.add(getNanoseconds(StatsClock::now() - Start));
+    }
+    SleepingThreads.fetch_sub(1, std::memory_order_relaxed);
+    return isWorkLeft || !isStopped || WakeEpoch != SeenEpoch;
+  }
+
+  bool isThereTasks() const {
+    return InboxSize.load(std::memory_order_relaxed) != 0 ||
+           std::any_of(Workers.begin(), Workers.end(), [](const auto &Worker) {
+             return !Worker.Tasks.empty();
+           });
+  }
+
+  bool takeFromInbox(WorkerState &Worker, IntegralTask &Task) {
+    if (InboxSize.load(std::memory_order_relaxed) == 0)
+      return false;
+    auto Lock =
+        lockCounting(InboxMtx, Worker.getCounter(&WorkerStats::InboxLockWait));
+    if (Inbox.empty())
+      return false;
+    Task = Inbox.front();
+    Inbox.pop_front();
+    InboxSize.store(Inbox.size(), std::memory_order_relaxed);
+    return true;
+  }
+
+  // Try to take the oldest task of any other thread, nearer tiers of
+  // victims first. Within a tier victims are visited starting from
+  // a random one, so that idle threads don't all hit the same deque.
+  // Returns the tier of the victim or COUNT_STEAL_TIERS.
+  unsigned stealTask(WorkerState &Worker, std::uint64_t &Seed,
+                     IntegralTask &Task) {
+    auto &Place = Worker.Placement;
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 7;
+    Seed ^= Seed << 17;
+    unsigned TierStart = 0;
+    for (auto Tier = 0u; Tier < COUNT_STEAL_TIERS; ++Tier) {
+      auto TierSize = Place.StealTierEnds[Tier] - TierStart;
+      for (auto Idx = 0u; Idx < TierSize; ++Idx) {
+        auto Victim = Place.StealOrder[TierStart + (Seed + Idx) % TierSize];
+        if (Workers[Victim].Tasks.steal(Task))
+          return Tier;
+      }
+      TierStart = Place.StealTierEnds[Tier];
+    }
+    return COUNT_STEAL_TIERS;
+  }
+
+  void runTask(WorkerState &Worker, const IntegralTask &Task) {
+    auto *Job = Task.Job;
+    // After a failure the remaining tasks of the job are only drained.
+    if (Job->isFailed()) {
+      Job->finishTask();
+      return;
+    }
+    Worker.isUsed.store(true, std::memory_order_relaxed);
+    try {
+      Job->processTask(Task, Worker, *this);
+    } catch (...) {
+      Worker.MyTasks.clear();
+      Job->fail(std::current_exception());
+      Job->finishTask();
+    }
+  }
+
+  // Own tasks first, then new jobs, then the tasks of other threads.
+  bool findTask(unsigned Rank, std::uint64_t &Seed, IntegralTask &Task) {
+    auto &Worker = Workers[Rank];
+    if (Worker.Tasks.pop(Task)) {
+      Worker.count(&WorkerStats::Popped);
+      return true;
+    }
+    if (takeFromInbox(Worker, Task)) {
+      Worker.count(&WorkerStats::FromInbox);
+      return true;
+    }
+    // Without a placement the locality of the victims is unknown.
+    static constexpr StatCounter WorkerStats::*TierCounters[] = {
+        &WorkerStats::StolenSameL3, &WorkerStats::StolenSameSocket,
+        &WorkerStats::StolenRemote};
+    auto Tier = stealTask(Worker, Seed, Task);
+    if (Tier != COUNT_STEAL_TIERS) {
+      Worker.count(&WorkerStats::Stolen);
+      if (Placement != ThreadPlacement::None)
+        Worker.count(TierCounters[Tier]);
+      return true;
+    }
+    Worker.count(&WorkerStats::FailedSteals);
+    return false;
+  }
+
+  void workerLoop(unsigned Rank) {
+    auto &Worker = Workers[Rank];
+    std::uint64_t Seed = 0x9E3779B97F4A7C15ull * (Rank + 1);
+    unsigned IdleRounds = 0;
+    // The clock is read only with the statistics, when a thread starts
+    // and stops to be idle and around every task.
+    bool isIdle = false;
+    StatsClock::time_point IdleStart;
+    auto stopIdling = [&] {
+      if (isIdle)
+        Worker.Stats.IdleTime.add(
+            getNanoseconds(StatsClock::now() - IdleStart));
+      isIdle = false;
+    };
+    IntegralTask Task;
+    while (true) {
+      if (findTask(Rank, Seed, Task)) {
+        IdleRounds = 0;
+        if (!Worker.isStatsEnabled) {
+          runTask(Worker, Task);
+          continue;
+        }
+        stopIdling();
+        auto Start = StatsClock::now();
+        runTask(Worker, Task);
+        Worker.Stats.BusyTime.add(getNanoseconds(StatsClock::now() - Start));
+        continue;
+      }
+      if (Worker.isStatsEnabled && !isIdle) {
+        isIdle = true;
+        IdleStart = StatsClock::now();
+      }
+      if (++IdleRounds < SPIN_ROUNDS_BEFORE_SLEEP) {
+        std::this_thread::yield();
+        continue;
+      }
+      IdleRounds = 0;
+      if (!sleep(Worker)) {
+        stopIdling();
+        return;
+      }
+    }
+  }
+};
+
+template <typename FuncTy>
+void IntegralJob<FuncTy>::processTask(IntegralTask Task, WorkerState &Worker,
+                                      Integrator &Pool) {
+  switch (Rule) {
+  case QuadratureRule::Trapezoid:
+    return refineTask<TrapezoidRule>(Task, Worker, Pool);
+  case QuadratureRule::Simpson:
+    return refineTask<SimpsonRule>(Task, Worker, Pool);
+  case QuadratureRule::GaussKronrod15:
+    return refineTask<GaussKronrod15Rule>(Task, Worker, Pool);
+  case QuadratureRule::TanhSinh:
+    // Integrated by TanhSinhJob.
+    break;
+  }
+}
+
+template <typename FuncTy>
+template <typename RuleTy>
+void IntegralJob<FuncTy>::refineTask(IntegralTask Task, WorkerState &Worker,
+                                     Integrator &Pool) {
+  if constexpr (isVectorized<FuncTy>::value)
+    return refineTasksBatched<RuleTy>(Task, Worker, Pool);
+  auto &MyTasks = Worker.MyTasks;
+  auto Range = Task.Range;
+  std::uint64_t Evaluations = evaluateEnds<RuleTy>(Range);
+  std::uint64_t Steps = 0, Splits = 0;
+  PartialResult Result;
+  while (true) {
+    auto Step = refine<RuleTy>(Func, Range);
+    ++Steps;
+
+    // If we have not achieved the required accuracy,
+    // we will divide the task into two.
+    if (std::abs(Step.Error / Step.Value) >= Epsilon) {
+      ++Splits;
+      MyTasks.push(getLeftHalf(Range, Step));
+      Range = getRightHalf(Range, Step);
+
+      // If other threads have taken everything from our deque, we
+      // hand them the oldest, that is the largest, postponed interval.
+      // This is an element of dynamic processor load balancing.
+      if (Worker.Tasks.empty())
+        Pool.publish(Worker, {this, MyTasks.popOldest()});
+    } else {
+      addToResult(Result, Step.Value);
+
+      if (MyTasks.empty())
+        break;
+      Range = MyTasks.pop();
+    }
+  }
+  Worker.countWork(Steps, Splits, Evaluations + Steps * RuleTy::CountNodes);
+  finishTask(Result, Worker);
+}
+
+// The batched mode: up to DoubleBatch::Width pending intervals are taken
+// from the top of the stack, the integrand is evaluated on all their
+// nodes together and then every interval is accepted or split on its
+// own.
+template <typename FuncTy>
+template <typename RuleTy>
+void IntegralJob<FuncTy>::refineTasksBatched(IntegralTask Task,
+                                             WorkerState &Worker,
+                                             Integrator &Pool) {
+  constexpr auto Width = DoubleBatch::Width;
+  constexpr auto CountNodes = RuleTy::CountNodes;
+  auto &MyTasks = Worker.MyTasks;
+  std::uint64_t Evaluations = evaluateEnds<RuleTy>(Task.Range);
+  std::uint64_t Steps = 0, Splits = 0;
+  MyTasks.push(Task.Range);
+
+  alignas(64) double Nodes[Width * CountNodes];
+  alignas(64) double Values[Width * CountNodes];
+  Interval Lanes[Width];
+  PartialResult Result;
+  while (!MyTasks.empty()) {
+    unsigned CountLanes = std::min<std::size_t>(Width, MyTasks.size());
+    MyTasks.popNewest(CountLanes, Lanes);
+
+    for (auto Lane = 0u; Lane < CountLanes; ++Lane)
+      RuleTy::getNodes(Lanes[Lane], Nodes + Lane * CountNodes);
+    evaluateBatched(Func, Nodes, Values, CountLanes * CountNodes);
+    Steps += CountLanes;
+
+    for (auto Lane = 0u; Lane < CountLanes; ++Lane) {
+      auto Step = RuleTy::combine(Lanes[Lane], Values + Lane * CountNodes);
+      if (std::abs(Step.Error / Step.Value) >= Epsilon) {
+        ++Splits;
+        MyTasks.push(getRightHalf(Lanes[Lane], Step));
+        MyTasks.push(getLeftHalf(Lanes[Lane], Step));
+      } else {
+        addToResult(Result, Step.Value);
+      }
+    }
+
+    if (MyTasks.size() > 1 && Worker.Tasks.empty())
+      Pool.publish(Worker, {this, MyTasks.popOldest()});
+  }
+  Worker.countWork(Steps, Splits, Evaluations + Steps * CountNodes);
+  finishTask(Result, Worker);
+}
+
+template <typename FuncTy, std::size_t CountComponents>
+void VectorIntegralJob<FuncTy, CountComponents>::processTask(
+    IntegralTask Task, WorkerState &Worker, Integrator &Pool) {
+  switch (Rule) {
+  case QuadratureRule::Trapezoid:
+    return refineTask<TrapezoidRule>(Task, Worker, Pool);
+  case QuadratureRule::Simpson:
+    return refineTask<SimpsonRule>(Task, Worker, Pool);
+  case QuadratureRule::GaussKronrod15:
+    return refineTask<GaussKronrod15Rule>(Task, Worker, Pool);
+  case QuadratureRule::TanhSinh:
+    // Integrated by TanhSinhJob.
+    break;
+  }
+}
+
+// The same depth-first refinement as for a scalar integrand. The end and
+// center values of the components don't fit into the records of the
+// deques, so a published interval goes there without them and the thread
+// that takes it evaluates them again.
+template <typename FuncTy, std::size_t CountComponents>
+template <typename RuleTy>
+void VectorIntegralJob<FuncTy, CountComponents>::refineTask(
+    IntegralTask Task, WorkerState &Worker, Integrator &Pool) {
+  constexpr auto NaN = std::numeric_limits<double>::quiet_NaN();
+  thread_local TaskStack<IntervalTy> MyTasks;
+  MyTasks.clear();
+  IntervalTy Range{Task.Range.Start, Task.Range.End, {}, {}, {}};
+  std::uint64_t Evaluations = 0, Steps = 0, Splits = 0;
+  if constexpr (RuleTy::UsesEnds) {
+    Range.FunctionInStart = Func(Range.Start);
+    Range.FunctionInEnd = Func(Range.End);
+    Evaluations = 2;
+  }
+  if constexpr (RuleTy::UsesCenter) {
+    Range.FunctionInCenter = Func((Range.Start + Range.End) / 2);
+    ++Evaluations;
+  }
+  PartialResult Result;
+  while (true) {
+    auto Step = refine<RuleTy>(Func, Range);
+    ++Steps;
+
+    if (Step.Error / getNorm(Step.Value) >= Epsilon) {
+      ++Splits;
+      MyTasks.push(getLeftHalf(Range, Step));
+      Range = getRightHalf(Range, Step);
+
+      if (Worker.Tasks.empty()) {
+        auto Oldest = MyTasks.popOldest();
+        Pool.publish(Worker,
+                     {this, {Oldest.Start, Oldest.End, NaN, NaN, NaN}});
+      }
+    } else {
+      addToResult(Result, Step.Value);
+
+      if (MyTasks.empty())
+        break;
+      Range = MyTasks.pop();
+    }
+  }
+  Worker.countWork(Steps, Splits, Evaluations + Steps * RuleTy::CountNodes);
+  finishTask(Result, Worker);
+}
+
+// Depth-first refinement of boxes, like that of intervals.
+template <typename FuncTy, unsigned Dimension>
+void CubatureJob<FuncTy, Dimension>::processTask(IntegralTask Task,
+                                                 WorkerState &Worker,
+                                                 Integrator &Pool) {
+  thread_local TaskStack<Box<Dimension>> MyTasks;
+  MyTasks.clear();
+  auto Range = Task.getBox<Dimension>();
+  std::uint64_t Steps = 0, Splits = 0;
+  PartialResult Result;
+  while (true) {
+    auto Step = GenzMalikRule<Dimension>::refine(Func, Range);
+    ++Steps;
+
+    if (std::abs(Step.Error / Step.Value) >= Epsilon) {
+      ++Splits;
+      MyTasks.push(getLowerHalf(Range, Step.SplitAxis));
+      Range = getUpperHalf(Range, Step.SplitAxis);
+
+      if (Worker.Tasks.empty())
+        Pool.publish(Worker, {this, MyTasks.popOldest()});
+    } else {
+      if (isReproducible)
+        Result.Exact.add(Step.Value);
+      else
+        Result.Sum += Step.Value;
+
+      if (MyTasks.empty())
+        break;
+      Range = MyTasks.pop();
+    }
+  }
+  Worker.countWork(Steps, Splits,
+                   Steps * GenzMalikRule<Dimension>::CountNodes);
+  finishTask(Result, Worker);
+}
+
+template <typename FuncTy>
+void GlobalErrorJob<FuncTy>::processTask(IntegralTask Task,
+                                         WorkerState &Worker,
+                                         Integrator &Pool) {
+  switch (Rule) {
+  case QuadratureRule::Trapezoid:
+    return refineTask<TrapezoidRule>(Task, Worker, Pool);
+  case QuadratureRule::Simpson:
+    return refineTask<SimpsonRule>(Task, Worker, Pool);
+  case QuadratureRule::GaussKronrod15:
+    return refineTask<GaussKronrod15Rule>(Task, Worker, Pool);
+  case QuadratureRule::TanhSinh:
+    // Integrated by TanhSinhJob.
+    break;
+  }
+}
+
+// The first task refines the whole range, the next ones are the chunks
+// of the rounds. The thread that completes a round publishes the chunks
+// of the next one and splits the first of them itself.
+template <typename FuncTy>
+template <typename RuleTy>
+void GlobalErrorJob<FuncTy>::refineTask(IntegralTask Task,
+                                        WorkerState &Worker,
+                                        Integrator &Pool) {
+  std::uint64_t Steps = 0, Splits = 0, Evaluations = 0;
+  bool isRoundFinished = true;
+  if (!isStarted) {
+    isStarted = true;
+    auto Range = Task.Range;
+    if (RuleTy::UsesEnds) {
+      Range.FunctionInStart = Func(Range.Start);
+      Range.FunctionInEnd = Func(Range.End);
+      Evaluations += 2;
+    }
+    if (RuleTy::UsesCenter) {
+      Range.FunctionInCenter = Func((Range.Start + Range.End) / 2);
+      ++Evaluations;
+    }
+    addInterval({Range, refine<RuleTy>(Func, Range), 0});
+    ++Steps;
+  } else {
+    auto Chunk = Task.Chunk;
+    splitChunk<RuleTy>(Chunk);
+    auto Count = std::min<std::size_t>(
+        GLOBAL_CHUNK_INTERVALS, Round.size() - Chunk * GLOBAL_CHUNK_INTERVALS);
+    Splits += Count;
+    Steps += 2 * Count;
+    isRoundFinished =
+        RoundPending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+  while (isRoundFinished) {
+    auto CountChunks = startRound();
+    if (CountChunks == 0)
+      break;
+    for (auto Idx = 1u; Idx < CountChunks; ++Idx)
+      Pool.publish(Worker, {this, Idx});
+    splitChunk<RuleTy>(0);
+    auto Count = std::min<std::size_t>(GLOBAL_CHUNK_INTERVALS, Round.size());
+    Splits += Count;
+    Steps += 2 * Count;
+    isRoundFinished =
+        RoundPending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+  Worker.countWork(Steps, Splits, Evaluations + Steps * RuleTy::CountNodes);
+  IntegralJobBase::finishTask();
+}
+
+// A chunk of nodes of the current level. The thread that completes the
+// level publishes the chunks of the next one and computes the first of
+// them itself.
+template <typename FuncTy>
+void TanhSinhJob<FuncTy>::processTask(IntegralTask Task, WorkerState &Worker,
+                                      Integrator &Pool) {
+  auto Chunk = Task.Chunk;
+  std::uint64_t Steps = 0, Evaluations = 0;
+  while (true) {
+    ChunkSums[Chunk] = sumChunk(Chunk, Evaluations);
+    ++Steps;
+    if (LevelPending.fetch_sub(1, std::memory_order_acq_rel) != 1 ||
+        finishLevel())
+      break;
+    auto CountChunks = startLevel(Level + 1);
+    for (auto Idx = 1u; Idx < CountChunks; ++Idx)
+      Pool.publish(Worker, {this, Idx});
+    Chunk = 0;
+  }
+  Worker.countWork(Steps, 0, Evaluations);
+  IntegralJobBase::finishTask();
+}
+
+// Integral of Func on [Start, End] with the given accuracy. Threads are
+// kept between calls: every number of threads gets its own Integrator,
+// created on the first use.
+template <typename FuncTy>
+IntegralValue<FuncTy>
+adaptiveIntegrate(const FuncTy &Func, double Start, double End, double Epsilon,
+                  unsigned CountThreads, IntegralOptions Options = {}) {
+  static std::mutex IntegratorsMtx;
+  static std::map<unsigned, std::unique_ptr<Integrator>> Integrators;
+
+  Integrator *Engine;
+  {
+    std::lock_guard<std::mutex> LockMtx{IntegratorsMtx};
+    auto &Slot = Integrators[CountThreads];
+    if (!Slot)
+      Slot = std::make_unique<Integrator>(CountThreads);
+    Engine = Slot.get();
+  }
+  return Engine->integrate(Func, Start, End, Epsilon, Options);
+}
+
+} // namespace Integration
+
+#endif // INTEGRAL_H
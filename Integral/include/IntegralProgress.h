@@ -0,0 +1,117 @@
+#ifndef INTEGRAL_PROGRESS_H
+#define INTEGRAL_PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+namespace Integration {
+
+// When a progressive integral stops before it reaches Epsilon.
+struct StopCondition {
+  // Stop at this moment with the estimate reached so far.
+  std::chrono::steady_clock::time_point Deadline =
+      std::chrono::steady_clock::time_point::max();
+  // Stop when the absolute error estimate is not larger.
+  double TargetError = 0;
+};
+
+enum class StopReason {
+  Running,
+  // Epsilon is reached.
+  Converged,
+  TargetError,
+  Deadline,
+  Cancelled,
+  // The limit of intervals or of their depth is reached, or the last
+  // level of tanh-sinh quadrature.
+  Limit,
+  // The integrand gave an infinity or a NaN.
+  NonFinite
+};
+
+// The integral over the whole range and its error estimate at some
+// moment of the computation.
+struct IntegralEstimate {
+  double Value = 0;
+  double Error = std::numeric_limits<double>::infinity();
+  // Intervals in the heap, or the nodes of tanh-sinh quadrature.
+  std::size_t Intervals = 0;
+  StopReason Reason = StopReason::Running;
+};
+
+// State shared by a running job and the handle of its caller. The job
+// publishes its estimate after every round and asks whether to stop.
+class IntegralProgress {
+  StopCondition Stop;
+  std::atomic<bool> isCancelled = false;
+  mutable std::mutex EstimateMtx;
+  IntegralEstimate Estimate;
+
+public:
+  explicit IntegralProgress(const StopCondition &Stop) : Stop(Stop) {}
+
+  void cancel() { isCancelled.store(true, std::memory_order_relaxed); }
+
+  IntegralEstimate getEstimate() const {
+    std::lock_guard<std::mutex> LockMtx{EstimateMtx};
+    return Estimate;
+  }
+
+  void setEstimate(const IntegralEstimate &NewEstimate) {
+    std::lock_guard<std::mutex> LockMtx{EstimateMtx};
+    Estimate = NewEstimate;
+  }
+
+  StopReason checkStop(double Error) const {
+    if (isCancelled.load(std::memory_order_relaxed))
+      return StopReason::Cancelled;
+    if (Error <= Stop.TargetError)
+      return StopReason::TargetError;
+    if (Stop.Deadline != std::chrono::steady_clock::time_point::max() &&
+        std::chrono::steady_clock::now() >= Stop.Deadline)
+      return StopReason::Deadline;
+    return StopReason::Running;
+  }
+};
+
+// Handle of an integral submitted with Integrator::submitProgressive.
+// The estimate may be polled while the threads work, and the job may be
+// cancelled: it stops after the current round with the best estimate
+// reached so far.
+class ProgressiveIntegral {
+  std::shared_ptr<IntegralProgress> Progress;
+  std::shared_future<double> Result;
+
+public:
+  ProgressiveIntegral(std::shared_ptr<IntegralProgress> Progress,
+                      std::future<double> Result)
+      : Progress(std::move(Progress)), Result(std::move(Result)) {}
+
+  IntegralEstimate getEstimate() const { return Progress->getEstimate(); }
+
+  void cancel() { Progress->cancel(); }
+
+  bool isFinished() const { return waitFor(std::chrono::seconds{0}); }
+
+  // Returns true if the job has finished within the time.
+  template <typename Rep, typename Period>
+  bool waitFor(std::chrono::duration<Rep, Period> Time) const {
+    return Result.wait_for(Time) == std::future_status::ready;
+  }
+
+  // Wait for the end and return the final estimate. Exceptions of the
+  // integrand are thrown here.
+  IntegralEstimate get() const {
+    Result.get();
+    return Progress->getEstimate();
+  }
+};
+
+} // namespace Integration
+
+#endif // INTEGRAL_PROGRESS_H
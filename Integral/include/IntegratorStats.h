@@ -0,0 +1,156 @@
+#ifndef INTEGRATOR_STATS_H
+#define INTEGRATOR_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "Topology.h"
+
+// Counters of a thread of the Integrator: the name of the field and its
+// key in the JSON output. Times are in nanoseconds.
+#define INTEGRATOR_STATS(X)                                                    \
+  X(Evaluations, "evaluations")                                                \
+  X(Steps, "steps")                                                            \
+  X(Splits, "splits")                                                          \
+  X(Published, "published")                                                    \
+  X(Popped, "popped")                                                          \
+  X(Stolen, "stolen")                                                          \
+  X(StolenSameL3, "stolen_same_l3")                                            \
+  X(StolenSameSocket, "stolen_same_socket")                                    \
+  X(StolenRemote, "stolen_remote")                                             \
+  X(FromInbox, "from_inbox")                                                   \
+  X(FailedSteals, "failed_steals")                                             \
+  X(Sleeps, "sleeps")                                                          \
+  X(BusyTime, "busy_ns")                                                       \
+  X(IdleTime, "idle_ns")                                                       \
+  X(SleepTime, "sleep_ns")                                                     \
+  X(InboxLockWait, "inbox_lock_wait_ns")                                       \
+  X(SleepLockWait, "sleep_lock_wait_ns")                                       \
+  X(ResultLockWait, "result_lock_wait_ns")
+
+namespace Integration {
+
+using StatsClock = std::chrono::steady_clock;
+
+inline std::uint64_t getNanoseconds(StatsClock::duration Time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Time).count();
+}
+
+// Written by its thread only, read by anyone.
+class StatCounter {
+  std::atomic<std::uint64_t> Value = 0;
+
+public:
+  void add(std::uint64_t Delta) {
+    Value.store(Value.load(std::memory_order_relaxed) + Delta,
+                std::memory_order_relaxed);
+  }
+  std::uint64_t get() const { return Value.load(std::memory_order_relaxed); }
+  void reset() { Value.store(0, std::memory_order_relaxed); }
+};
+
+// Values of the counters of a thread at some moment.
+struct WorkerStatsSnapshot {
+#define STATS_FIELD(Name, Key) std::uint64_t Name = 0;
+  INTEGRATOR_STATS(STATS_FIELD)
+#undef STATS_FIELD
+
+  WorkerStatsSnapshot &operator+=(const WorkerStatsSnapshot &Rhs) {
+#define STATS_FIELD(Name, Key) Name += Rhs.Name;
+    INTEGRATOR_STATS(STATS_FIELD)
+#undef STATS_FIELD
+    return *this;
+  }
+};
+
+struct WorkerStats {
+#define STATS_FIELD(Name, Key) StatCounter Name;
+  INTEGRATOR_STATS(STATS_FIELD)
+#undef STATS_FIELD
+
+  WorkerStatsSnapshot get() const {
+    WorkerStatsSnapshot Snapshot;
+#define STATS_FIELD(Name, Key) Snapshot.Name = Name.get();
+    INTEGRATOR_STATS(STATS_FIELD)
+#undef STATS_FIELD
+    return Snapshot;
+  }
+
+  void reset() {
+#define STATS_FIELD(Name, Key) Name.reset();
+    INTEGRATOR_STATS(STATS_FIELD)
+#undef STATS_FIELD
+  }
+};
+
+// Lock the mutex and add the time of waiting for it to WaitTime, if it is
+// given. The clock is read only if the mutex is busy.
+inline std::unique_lock<std::mutex> lockCounting(std::mutex &Mtx,
+                                                 StatCounter *WaitTime) {
+  if (!WaitTime)
+    return std::unique_lock<std::mutex>{Mtx};
+  std::unique_lock<std::mutex> Lock{Mtx, std::try_to_lock};
+  if (!Lock.owns_lock()) {
+    auto Start = StatsClock::now();
+    Lock.lock();
+    WaitTime->add(getNanoseconds(StatsClock::now() - Start));
+  }
+  return Lock;
+}
+
+inline void writeSnapshot(std::ostream &Out,
+                          const WorkerStatsSnapshot &Snapshot) {
+  const char *Separator = "";
+#define STATS_FIELD(Name, Key)                                                 \
+  Out << Separator << "\"" Key "\": " << Snapshot.Name;                        \
+  Separator = ", ";
+  INTEGRATOR_STATS(STATS_FIELD)
+#undef STATS_FIELD
+}
+
+inline void writePlacement(std::ostream &Out, const WorkerPlacement &Place) {
+  auto &Location = Place.Location;
+  Out << "\"cpu\": " << Location.Cpu << ", \"node\": " << Location.Node
+      << ", \"package\": " << Location.Package << ", \"l3\": " << Location.L3
+      << ", \"pinned\": " << (Place.isPinned ? "true" : "false")
+      << ", \"steal_order\": [";
+  unsigned Idx = 0;
+  for (auto Tier = 0u; Tier < COUNT_STEAL_TIERS; ++Tier) {
+    Out << (Tier ? ", [" : "[");
+    for (; Idx < Place.StealTierEnds[Tier]; ++Idx)
+      Out << Place.StealOrder[Idx]
+          << (Idx + 1 == Place.StealTierEnds[Tier] ? "" : ", ");
+    Out << "]";
+  }
+  Out << "], ";
+}
+
+// The counters of all the threads and their sums as JSON. Places, if
+// given, tell where every thread runs and the tiers of its victims.
+inline void writeStatsJson(std::ostream &Out,
+                           const std::vector<WorkerStatsSnapshot> &Workers,
+                           ThreadPlacement Placement = ThreadPlacement::None,
+                           const std::vector<WorkerPlacement> &Places = {}) {
+  WorkerStatsSnapshot Total;
+  Out << "{\n  \"threads\": " << Workers.size() << ",\n  \"placement\": \""
+      << getPlacementName(Placement) << "\",\n  \"workers\": [\n";
+  for (auto Rank = 0u; Rank < Workers.size(); ++Rank) {
+    Out << "    {\"rank\": " << Rank << ", ";
+    if (Rank < Places.size())
+      writePlacement(Out, Places[Rank]);
+    writeSnapshot(Out, Workers[Rank]);
+    Out << (Rank + 1 == Workers.size() ? "}\n" : "},\n");
+    Total += Workers[Rank];
+  }
+  Out << "  ],\n  \"total\": {";
+  writeSnapshot(Out, Total);
+  Out << "}\n}\n";
+}
+
+} // namespace Integration
+
+#endif // INTEGRATOR_STATS_H
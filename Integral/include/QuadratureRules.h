@@ -0,0 +1,309 @@
+#ifndef QUADRATURE_RULES_H
+#define QUADRATURE_RULES_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace Integration {
+
+// TanhSinh is not a rule of one interval: it is the double exponential
+// quadrature over the whole range, see TanhSinhJob.
+enum class QuadratureRule { Trapezoid, Simpson, GaussKronrod15, TanhSinh };
+
+inline QuadratureRule getQuadratureRule(const std::string &Name) {
+  if (Name == "trapezoid")
+    return QuadratureRule::Trapezoid;
+  if (Name == "simpson")
+    return QuadratureRule::Simpson;
+  if (Name == "gk15")
+    return QuadratureRule::GaussKronrod15;
+  if (Name == "tanhsinh")
+    return QuadratureRule::TanhSinh;
+  throw std::logic_error(
+      "Unknown quadrature rule \"" + Name +
+      "\", expected trapezoid, simpson, gk15 or tanhsinh");
+}
+
+// Interval of a pending task together with the integrand values at its
+// ends and center, computed by the parent interval and not evaluated
+// again. The center is known only for the rules that use it, NaN is an
+// unknown value. The local stacks of the threads consist of these
+// records.
+struct Interval {
+  double Start;
+  double End;
+  double FunctionInStart;
+  double FunctionInEnd;
+  double FunctionInCenter;
+};
+static_assert(sizeof(Interval) == 40);
+
+// Result of one refinement step of an interval. Value and Error are the
+// new estimate of the integral on the interval and of its absolute
+// error. FunctionInCenter is the value at the center, which becomes an
+// end value of both halves if the interval is split, and the values at
+// the quarters become the centers of the halves.
+struct Refinement {
+  double Value;
+  double Error;
+  double FunctionInCenter;
+  double FunctionInLeftCenter = std::numeric_limits<double>::quiet_NaN();
+  double FunctionInRightCenter = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Every rule has the same interface: the nodes where a refinement step
+// needs the integrand, and the step itself, computed from the values in
+// these nodes and the cached end values. So the integrand may be
+// evaluated one node at a time or in batches over the nodes of several
+// intervals. Rules that use the end or center values say so, these
+// values of the first interval are evaluated only for them.
+
+// Trapezoids on the whole interval and on its halves: the only new node
+// of a step is the center.
+struct TrapezoidRule {
+  static constexpr unsigned CountNodes = 1;
+  static constexpr bool UsesEnds = true;
+  static constexpr bool UsesCenter = false;
+
+  static void getNodes(const Interval &Task, double *Nodes) {
+    Nodes[0] = (Task.Start + Task.End) / 2;
+  }
+
+  static Refinement combine(const Interval &Task, const double *Values) {
+    double Center = (Task.Start + Task.End) / 2;
+    double FunctionInCenter = Values[0];
+
+    double PartOfIntegral = (Task.FunctionInEnd + Task.FunctionInStart) *
+                            (Task.End - Task.Start) / 2;
+    double PartOfIntegralStartCenter =
+        (FunctionInCenter + Task.FunctionInStart) * (Center - Task.Start) / 2;
+    double PartOfIntegralCenterEnd =
+        (Task.FunctionInEnd + FunctionInCenter) * (Task.End - Center) / 2;
+    double BetterPartOfIntegral =
+        PartOfIntegralStartCenter + PartOfIntegralCenterEnd;
+    return {BetterPartOfIntegral,
+            std::abs(BetterPartOfIntegral - PartOfIntegral), FunctionInCenter};
+  }
+};
+
+// Simpson parabolas on the whole interval and on its halves. The
+// difference of the two estimates is 15 times the error of the better
+// one, which also gives a Richardson correction of the value. The center
+// is a quarter of the parent interval, so the only new nodes of a step
+// are the quarters.
+struct SimpsonRule {
+  static constexpr unsigned CountNodes = 2;
+  static constexpr bool UsesEnds = true;
+  static constexpr bool UsesCenter = true;
+
+  static void getNodes(const Interval &Task, double *Nodes) {
+    double Center = (Task.Start + Task.End) / 2;
+    Nodes[0] = (Task.Start + Center) / 2;
+    Nodes[1] = (Center + Task.End) / 2;
+  }
+
+  static Refinement combine(const Interval &Task, const double *Values) {
+    double Center = (Task.Start + Task.End) / 2;
+    double FunctionInCenter = Task.FunctionInCenter;
+    double PartOfIntegral =
+        (Task.End - Task.Start) / 6 *
+        (Task.FunctionInStart + 4 * FunctionInCenter + Task.FunctionInEnd);
+    double PartOfIntegralStartCenter =
+        (Center - Task.Start) / 6 *
+        (Task.FunctionInStart + 4 * Values[0] + FunctionInCenter);
+    double PartOfIntegralCenterEnd =
+        (Task.End - Center) / 6 *
+        (FunctionInCenter + 4 * Values[1] + Task.FunctionInEnd);
+    double BetterPartOfIntegral =
+        PartOfIntegralStartCenter + PartOfIntegralCenterEnd;
+    double Difference = BetterPartOfIntegral - PartOfIntegral;
+    return {BetterPartOfIntegral + Difference / 15, std::abs(Difference) / 15,
+            FunctionInCenter, Values[0], Values[1]};
+  }
+};
+
+// 7-point Gauss rule with its 15-point Kronrod extension, the error
+// estimate is the one of QUADPACK QK15. Every step evaluates the
+// integrand in the 15 inner nodes of the interval, the ends are not
+// needed.
+struct GaussKronrod15Rule {
+  static constexpr unsigned CountNodes = 15;
+  static constexpr bool UsesEnds = false;
+  static constexpr bool UsesCenter = false;
+
+  // Kronrod nodes on [-1, 1], the odd ones are the Gauss nodes.
+  static constexpr double XGK[8] = {
+      0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+      0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+      0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+      0.207784955007898467600689403773245, 0.000000000000000000000000000000000};
+  static constexpr double WGK[8] = {
+      0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+      0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+      0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+      0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+  static constexpr double WG[4] = {
+      0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+      0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+
+  // The center first, then pairs of nodes symmetric about it.
+  static void getNodes(const Interval &Task, double *Nodes) {
+    double Center = (Task.Start + Task.End) / 2;
+    double HalfLength = (Task.End - Task.Start) / 2;
+    Nodes[0] = Center;
+    for (auto Idx = 0; Idx < 7; ++Idx) {
+      double Abscissa = HalfLength * XGK[Idx];
+      Nodes[2 * Idx + 1] = Center - Abscissa;
+      Nodes[2 * Idx + 2] = Center + Abscissa;
+    }
+  }
+
+  static Refinement combine(const Interval &Task, const double *Values) {
+    constexpr double Epmach = std::numeric_limits<double>::epsilon();
+    constexpr double Uflow = std::numeric_limits<double>::min();
+
+    double HalfLength = (Task.End - Task.Start) / 2;
+    double AbsHalfLength = std::abs(HalfLength);
+
+    double FunctionInCenter = Values[0];
+    double ResultGauss = FunctionInCenter * WG[3];
+    double ResultKronrod = FunctionInCenter * WGK[7];
+    double ResultAbs = std::abs(ResultKronrod);
+    for (auto Idx = 0; Idx < 7; ++Idx) {
+      double Left = Values[2 * Idx + 1];
+      double Right = Values[2 * Idx + 2];
+      ResultKronrod += WGK[Idx] * (Left + Right);
+      ResultAbs += WGK[Idx] * (std::abs(Left) + std::abs(Right));
+      if (Idx % 2)
+        ResultGauss += WG[Idx / 2] * (Left + Right);
+    }
+
+    double HalfKronrod = ResultKronrod / 2;
+    double ResultAsc = WGK[7] * std::abs(FunctionInCenter - HalfKronrod);
+    for (auto Idx = 0; Idx < 7; ++Idx)
+      ResultAsc += WGK[Idx] * (std::abs(Values[2 * Idx + 1] - HalfKronrod) +
+                               std::abs(Values[2 * Idx + 2] - HalfKronrod));
+
+    double Result = ResultKronrod * HalfLength;
+    ResultAbs *= AbsHalfLength;
+    ResultAsc *= AbsHalfLength;
+    double Error = std::abs((ResultKronrod - ResultGauss) * HalfLength);
+    if (ResultAsc != 0 && Error != 0)
+      Error = ResultAsc * std::min(1., std::pow(200 * Error / ResultAsc, 1.5));
+    if (ResultAbs > Uflow / (50 * Epmach))
+      Error = std::max(Epmach * 50 * ResultAbs, Error);
+
+    return {Result, Error, FunctionInCenter};
+  }
+};
+
+// One refinement step with the integrand called node by node.
+template <typename RuleTy, typename FuncTy>
+Refinement refine(const FuncTy &Func, const Interval &Task) {
+  double Nodes[RuleTy::CountNodes], Values[RuleTy::CountNodes];
+  RuleTy::getNodes(Task, Nodes);
+  for (auto Idx = 0u; Idx < RuleTy::CountNodes; ++Idx)
+    Values[Idx] = Func(Nodes[Idx]);
+  return RuleTy::combine(Task, Values);
+}
+
+// Interval of a vector-valued integrand, which returns
+// std::array<double, CountComponents>. All the components share the same
+// nodes, so one subdivision serves all the integrals.
+template <std::size_t CountComponents> struct VectorInterval {
+  using ValueTy = std::array<double, CountComponents>;
+  double Start;
+  double End;
+  ValueTy FunctionInStart;
+  ValueTy FunctionInEnd;
+  ValueTy FunctionInCenter;
+};
+
+// Error is the maximum of the errors of the components.
+template <std::size_t CountComponents> struct VectorRefinement {
+  using ValueTy = std::array<double, CountComponents>;
+  ValueTy Value;
+  double Error;
+  ValueTy FunctionInCenter;
+  ValueTy FunctionInLeftCenter;
+  ValueTy FunctionInRightCenter;
+};
+
+// One refinement step of a vector-valued integrand: the integrand is
+// called once in every node, then the scalar rule is applied to every
+// component on its own.
+template <typename RuleTy, typename FuncTy, std::size_t CountComponents>
+VectorRefinement<CountComponents>
+refine(const FuncTy &Func, const VectorInterval<CountComponents> &Task) {
+  using ValueTy = std::array<double, CountComponents>;
+  double Nodes[RuleTy::CountNodes];
+  ValueTy Values[RuleTy::CountNodes];
+  RuleTy::getNodes({Task.Start, Task.End, 0, 0, 0}, Nodes);
+  for (auto Idx = 0u; Idx < RuleTy::CountNodes; ++Idx)
+    Values[Idx] = Func(Nodes[Idx]);
+
+  VectorRefinement<CountComponents> Res;
+  Res.Error = 0;
+  for (auto Component = 0u; Component < CountComponents; ++Component) {
+    double ComponentValues[RuleTy::CountNodes];
+    for (auto Idx = 0u; Idx < RuleTy::CountNodes; ++Idx)
+      ComponentValues[Idx] = Values[Idx][Component];
+    auto Step = RuleTy::combine({Task.Start, Task.End,
+                                 Task.FunctionInStart[Component],
+                                 Task.FunctionInEnd[Component],
+                                 Task.FunctionInCenter[Component]},
+                                ComponentValues);
+    Res.Value[Component] = Step.Value;
+    Res.FunctionInCenter[Component] = Step.FunctionInCenter;
+    Res.FunctionInLeftCenter[Component] = Step.FunctionInLeftCenter;
+    Res.FunctionInRightCenter[Component] = Step.FunctionInRightCenter;
+    Res.Error = std::max(Res.Error, Step.Error);
+  }
+  return Res;
+}
+
+// Largest absolute value of the components, the norm that is compared
+// with the error.
+template <std::size_t CountComponents>
+double getNorm(const std::array<double, CountComponents> &Value) {
+  double Norm = 0;
+  for (auto Component : Value)
+    Norm = std::max(Norm, std::abs(Component));
+  return Norm;
+}
+
+// Halves of an interval after a refinement step.
+inline Interval getLeftHalf(const Interval &Task, const Refinement &Step) {
+  return {Task.Start, (Task.Start + Task.End) / 2, Task.FunctionInStart,
+          Step.FunctionInCenter, Step.FunctionInLeftCenter};
+}
+
+inline Interval getRightHalf(const Interval &Task, const Refinement &Step) {
+  return {(Task.Start + Task.End) / 2, Task.End, Step.FunctionInCenter,
+          Task.FunctionInEnd, Step.FunctionInRightCenter};
+}
+
+template <std::size_t CountComponents>
+VectorInterval<CountComponents>
+getLeftHalf(const VectorInterval<CountComponents> &Task,
+            const VectorRefinement<CountComponents> &Step) {
+  return {Task.Start, (Task.Start + Task.End) / 2, Task.FunctionInStart,
+          Step.FunctionInCenter, Step.FunctionInLeftCenter};
+}
+
+template <std::size_t CountComponents>
+VectorInterval<CountComponents>
+getRightHalf(const VectorInterval<CountComponents> &Task,
+             const VectorRefinement<CountComponents> &Step) {
+  return {(Task.Start + Task.End) / 2, Task.End, Step.FunctionInCenter,
+          Task.FunctionInEnd, Step.FunctionInRightCenter};
+}
+
+} // namespace Integration
+
+#endif // QUADRATURE_RULES_H
@@ -0,0 +1,169 @@
+#ifndef RANGE_TRANSFORMS_H
+#define RANGE_TRANSFORMS_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <utility>
+
+namespace Integration {
+
+// Which ends of a range are infinite.
+enum class RangeKind { Finite, UpperInfinite, LowerInfinite, Infinite };
+
+inline RangeKind getRangeKind(double Start, double End) {
+  bool isLowerInfinite = std::isinf(std::min(Start, End));
+  bool isUpperInfinite = std::isinf(std::max(Start, End));
+  if (isLowerInfinite && isUpperInfinite)
+    return RangeKind::Infinite;
+  if (isUpperInfinite)
+    return RangeKind::UpperInfinite;
+  if (isLowerInfinite)
+    return RangeKind::LowerInfinite;
+  return RangeKind::Finite;
+}
+
+inline double scaleValue(double Value, double Factor) { return Value * Factor; }
+
+template <std::size_t CountComponents>
+std::array<double, CountComponents>
+scaleValue(std::array<double, CountComponents> Value, double Factor) {
+  for (auto &Component : Value)
+    Component *= Factor;
+  return Value;
+}
+
+// Integrand on an infinite range turned into an integrand on [0, 1], or
+// on [-1, 1] if both ends are infinite, for the adaptive rules:
+//   [a, +inf)     x = a + T / (1 - T),
+//   (-inf, b]     x = b - T / (1 - T),
+//   (-inf, +inf)  x = T / (1 - T^2).
+// The integrand is taken to vanish at infinity, so the infinite ends
+// give 0 and are never evaluated.
+template <typename FuncTy> struct InfiniteRangeFunction {
+  FuncTy Func;
+  RangeKind Kind;
+  double Bound;
+  // -1 if the range was given from the larger end to the smaller one.
+  double Sign;
+
+  auto operator()(double T) const {
+    using ValueTy = decltype(Func(T));
+    if (Kind == RangeKind::Infinite) {
+      double Rest = 1 - T * T;
+      if (Rest <= 0)
+        return ValueTy{};
+      return scaleValue(Func(T / Rest), Sign * (1 + T * T) / (Rest * Rest));
+    }
+    double Rest = 1 - T;
+    if (Rest <= 0)
+      return ValueTy{};
+    double Shift = T / Rest;
+    double X = Kind == RangeKind::UpperInfinite ? Bound + Shift : Bound - Shift;
+    return scaleValue(Func(X), Sign / (Rest * Rest));
+  }
+
+  // The range of T.
+  std::pair<double, double> getRange() const {
+    return {Kind == RangeKind::Infinite ? -1. : 0., 1.};
+  }
+};
+
+template <typename FuncTy>
+InfiniteRangeFunction<FuncTy> substituteInfiniteRange(FuncTy Func,
+                                                      double Start,
+                                                      double End) {
+  auto Kind = getRangeKind(Start, End);
+  double Sign = Start <= End ? 1 : -1;
+  double Bound = 0;
+  if (Kind == RangeKind::UpperInfinite)
+    Bound = std::min(Start, End);
+  else if (Kind == RangeKind::LowerInfinite)
+    Bound = std::max(Start, End);
+  return {std::move(Func), Kind, Bound, Sign};
+}
+
+// Double exponential substitution x(T) of a range, T runs over the whole
+// line and the integrand times x'(T) decays double exponentially, so the
+// trapezoid rule in T converges exponentially even with singularities
+// of the integrand at the finite ends:
+//   [a, b]        tanh-sinh  x = c + h tanh(pi/2 sinh T),
+//   [a, +inf)     exp-sinh   x = a + exp(pi/2 sinh T),
+//   (-inf, +inf)  sinh-sinh  x = sinh(pi/2 sinh T).
+// Beyond [TLeft, TRight] the weights are negligible or x overflows.
+class DoubleExponentialMap {
+  static constexpr double HalfPi = std::numbers::pi / 2;
+
+  RangeKind Kind;
+  double Start;
+  double End;
+  double Sign;
+
+public:
+  double TLeft;
+  double TRight;
+
+  DoubleExponentialMap(double RangeStart, double RangeEnd)
+      : Kind(getRangeKind(RangeStart, RangeEnd)),
+        Start(std::min(RangeStart, RangeEnd)),
+        End(std::max(RangeStart, RangeEnd)),
+        Sign(RangeStart <= RangeEnd ? 1 : -1) {
+    switch (Kind) {
+    case RangeKind::Finite:
+      // The distance to the end is about exp(-pi sinh T), for T = 6 it
+      // is 1e-275, so even the strong singularities are resolved.
+      TLeft = TRight = 6;
+      break;
+    case RangeKind::UpperInfinite:
+    case RangeKind::LowerInfinite:
+      // x - a runs from exp(-316) to exp(116).
+      TLeft = 6;
+      TRight = 5;
+      break;
+    case RangeKind::Infinite:
+      TLeft = TRight = 5;
+      break;
+    }
+  }
+
+  // The node and its weight x'(T). Returns false if the node falls on
+  // an end of the range or beyond the doubles, it is skipped then.
+  bool getNode(double T, double &X, double &Weight) const {
+    double Exponent = HalfPi * std::sinh(T);
+    double Derivative = HalfPi * std::cosh(T);
+    switch (Kind) {
+    case RangeKind::Finite: {
+      // Through the distance to the nearest end, so that the nodes near
+      // the ends are not rounded to them.
+      double HalfWidth = (End - Start) / 2;
+      double Decay = std::exp(-2 * std::abs(Exponent));
+      double Distance = HalfWidth * 2 * Decay / (1 + Decay);
+      X = T < 0 ? Start + Distance : End - Distance;
+      Weight = HalfWidth * Derivative * 4 * Decay / ((1 + Decay) * (1 + Decay));
+      break;
+    }
+    case RangeKind::UpperInfinite:
+    case RangeKind::LowerInfinite: {
+      double Distance = std::exp(Exponent);
+      X = Kind == RangeKind::UpperInfinite ? Start + Distance : End - Distance;
+      Weight = Derivative * Distance;
+      break;
+    }
+    // RangeKind::Infinite. A default rather than a case, so that X and
+    // Weight are set on every path.
+    default:
+      X = std::sinh(Exponent);
+      Weight = Derivative * std::cosh(Exponent);
+      break;
+    }
+    Weight *= Sign;
+    return std::isfinite(X) && std::isfinite(Weight) && Weight != 0 &&
+           X != Start && X != End;
+  }
+};
+
+} // namespace Integration
+
+#endif // RANGE_TRANSFORMS_H
@@ -0,0 +1,314 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace Integration {
+
+// A few doubles processed together: 8 lanes with AVX-512, 4 lanes with
+// AVX2, and 4 lanes of plain scalar code otherwise. Only what the
+// integrands and the cos/sin kernels below need is defined.
+class DoubleBatch {
+public:
+#if defined(__AVX512F__)
+  static constexpr unsigned Width = 8;
+  using RegTy = __m512d;
+#elif defined(__AVX__)
+  static constexpr unsigned Width = 4;
+  using RegTy = __m256d;
+#else
+  static constexpr unsigned Width = 4;
+  struct RegTy {
+    double Lanes[Width];
+  };
+#endif
+
+  RegTy Reg;
+
+  DoubleBatch() = default;
+  DoubleBatch(RegTy Reg) : Reg(Reg) {}
+  DoubleBatch(double Val) : Reg(broadcast(Val)) {}
+
+  static DoubleBatch load(const double *Ptr) {
+#if defined(__AVX512F__)
+    return _mm512_loadu_pd(Ptr);
+#elif defined(__AVX__)
+    return _mm256_loadu_pd(Ptr);
+#else
+    DoubleBatch Res;
+    for (auto Lane = 0u; Lane < Width; ++Lane)
+      Res.Reg.Lanes[Lane] = Ptr[Lane];
+    return Res;
+#endif
+  }
+
+  void store(double *Ptr) const {
+#if defined(__AVX512F__)
+    _mm512_storeu_pd(Ptr, Reg);
+#elif defined(__AVX__)
+    _mm256_storeu_pd(Ptr, Reg);
+#else
+    for (auto Lane = 0u; Lane < Width; ++Lane)
+      Ptr[Lane] = Reg.Lanes[Lane];
+#endif
+  }
+
+  // True if every lane is a number not greater than Limit by absolute
+  // value.
+  bool allAbsNotGreater(double Limit) const {
+#if defined(__AVX512F__)
+    return _mm512_cmp_pd_mask(_mm512_abs_pd(Reg), broadcast(Limit),
+                              _CMP_LE_OQ) == 0xFF;
+#elif defined(__AVX__)
+    auto Abs = _mm256_andnot_pd(_mm256_set1_pd(-0.), Reg);
+    return _mm256_movemask_pd(
+               _mm256_cmp_pd(Abs, broadcast(Limit), _CMP_LE_OQ)) == 0xF;
+#else
+    for (auto Lane = 0u; Lane < Width; ++Lane)
+      if (!(std::abs(Reg.Lanes[Lane]) <= Limit))
+        return false;
+    return true;
+#endif
+  }
+
+  friend DoubleBatch round(DoubleBatch X) {
+#if defined(__AVX512F__)
+    return _mm512_roundscale_pd(X.Reg,
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+#elif defined(__AVX__)
+    return _mm256_round_pd(X.Reg,
+                           _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+#else
+    return map(X, [](double Val) { return std::nearbyint(Val); });
+#endif
+  }
+
+  friend DoubleBatch floor(DoubleBatch X) {
+#if defined(__AVX512F__)
+    return _mm512_roundscale_pd(X.Reg,
+                                _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+#elif defined(__AVX__)
+    return _mm256_floor_pd(X.Reg);
+#else
+    return map(X, [](double Val) { return std::floor(Val); });
+#endif
+  }
+
+  // A * B + C, fused where the hardware allows.
+  friend DoubleBatch fma(DoubleBatch A, DoubleBatch B, DoubleBatch C) {
+#if defined(__AVX512F__)
+    return _mm512_fmadd_pd(A.Reg, B.Reg, C.Reg);
+#elif defined(__AVX__) && defined(__FMA__)
+    return _mm256_fmadd_pd(A.Reg, B.Reg, C.Reg);
+#else
+    return A * B + C;
+#endif
+  }
+
+#if defined(__AVX512F__)
+#define BATCH_BINARY_OP(Op, Intrinsic)                                         \
+  friend DoubleBatch operator Op(DoubleBatch A, DoubleBatch B) {               \
+    return _mm512_##Intrinsic##_pd(A.Reg, B.Reg);                              \
+  }
+#elif defined(__AVX__)
+#define BATCH_BINARY_OP(Op, Intrinsic)                                         \
+  friend DoubleBatch operator Op(DoubleBatch A, DoubleBatch B) {               \
+    return _mm256_##Intrinsic##_pd(A.Reg, B.Reg);                              \
+  }
+#else
+#define BATCH_BINARY_OP(Op, Intrinsic)                                         \
+  friend DoubleBatch operator Op(DoubleBatch A, DoubleBatch B) {               \
+    DoubleBatch Res;                                                           \
+    for (auto Lane = 0u; Lane < Width; ++Lane)                                 \
+      Res.Reg.Lanes[Lane] = A.Reg.Lanes[Lane] Op B.Reg.Lanes[Lane];            \
+    return Res;                                                                \
+  }
+#endif
+  BATCH_BINARY_OP(+, add)
+  BATCH_BINARY_OP(-, sub)
+  BATCH_BINARY_OP(*, mul)
+  BATCH_BINARY_OP(/, div)
+#undef BATCH_BINARY_OP
+
+  friend DoubleBatch operator-(DoubleBatch X) { return DoubleBatch(0.) - X; }
+  DoubleBatch &operator+=(DoubleBatch Rhs) { return *this = *this + Rhs; }
+  DoubleBatch &operator-=(DoubleBatch Rhs) { return *this = *this - Rhs; }
+  DoubleBatch &operator*=(DoubleBatch Rhs) { return *this = *this * Rhs; }
+  DoubleBatch &operator/=(DoubleBatch Rhs) { return *this = *this / Rhs; }
+
+  // Apply the scalar function to every lane.
+  template <typename FuncTy>
+  friend DoubleBatch map(DoubleBatch X, const FuncTy &Func) {
+    alignas(64) double Lanes[Width];
+    X.store(Lanes);
+    for (auto Lane = 0u; Lane < Width; ++Lane)
+      Lanes[Lane] = Func(Lanes[Lane]);
+    return load(Lanes);
+  }
+
+private:
+  static RegTy broadcast(double Val) {
+#if defined(__AVX512F__)
+    return _mm512_set1_pd(Val);
+#elif defined(__AVX__)
+    return _mm256_set1_pd(Val);
+#else
+    RegTy Res;
+    for (auto Lane = 0u; Lane < Width; ++Lane)
+      Res.Lanes[Lane] = Val;
+    return Res;
+#endif
+  }
+};
+
+namespace SimdKernels {
+
+// Arguments beyond this bound lose precision in the three-part
+// reduction below, such batches are computed lane by lane with std::.
+constexpr double MaxReducedArgument = 1e5;
+
+// Cody-Waite reduction X = Quadrant * pi/2 + Reduced with |Reduced| <=
+// pi/4, the parts of pi/2 are those of fdlibm.
+inline void reduceByHalfPi(DoubleBatch X, DoubleBatch &Reduced,
+                           DoubleBatch &Quadrant) {
+  constexpr double TwoOverPi = 6.36619772367581382433e-01;
+  constexpr double HalfPi1 = 1.57079632673412561417e+00;
+  constexpr double HalfPi2 = 6.07710050630396597660e-11;
+  constexpr double HalfPi3 = 2.02226624871116645580e-21;
+  Quadrant = round(X * TwoOverPi);
+  Reduced = fma(-Quadrant, HalfPi1, X);
+  Reduced = fma(-Quadrant, HalfPi2, Reduced);
+  Reduced = fma(-Quadrant, HalfPi3, Reduced);
+}
+
+// fdlibm __kernel_sin and __kernel_cos polynomials on [-pi/4, pi/4].
+inline DoubleBatch sinKernel(DoubleBatch X) {
+  constexpr double S1 = -1.66666666666666324348e-01;
+  constexpr double S2 = 8.33333333332248946124e-03;
+  constexpr double S3 = -1.98412698298579493134e-04;
+  constexpr double S4 = 2.75573137070700676789e-06;
+  constexpr double S5 = -2.50507602534068634195e-08;
+  constexpr double S6 = 1.58969099521155010221e-10;
+  auto Z = X * X;
+  auto Poly = fma(Z, fma(Z, fma(Z, fma(Z, S6, S5), S4), S3), S2);
+  return fma(X * Z, fma(Z, Poly, S1), X);
+}
+
+inline DoubleBatch cosKernel(DoubleBatch X) {
+  constexpr double C1 = 4.16666666666666019037e-02;
+  constexpr double C2 = -1.38888888888741095749e-03;
+  constexpr double C3 = 2.48015872894767294178e-05;
+  constexpr double C4 = -2.75573143513906633035e-07;
+  constexpr double C5 = 2.08757232129817482790e-09;
+  constexpr double C6 = -1.13596475577881948265e-11;
+  auto Z = X * X;
+  auto R = Z * fma(Z, fma(Z, fma(Z, fma(Z, fma(Z, C6, C5), C4), C3), C2), C1);
+  auto HalfZ = Z * 0.5;
+  auto W = DoubleBatch(1.) - HalfZ;
+  return W + (((DoubleBatch(1.) - W) - HalfZ) + Z * R);
+}
+
+// Quadrant modulo 4 gives which kernel and which sign to take. The
+// choice is done with exact arithmetic on 0 and 1 instead of masks, so
+// it is the same code for every instruction set.
+inline DoubleBatch sinOrCos(DoubleBatch X, bool isCos) {
+  DoubleBatch Reduced, Quadrant;
+  reduceByHalfPi(X, Reduced, Quadrant);
+  if (isCos)
+    Quadrant += 1.;
+  auto Mod4 = Quadrant - floor(Quadrant * 0.25) * 4.;
+  auto High = floor(Mod4 * 0.5);
+  auto Odd = Mod4 - High * 2.;
+  auto Res = Odd * cosKernel(Reduced) +
+             (DoubleBatch(1.) - Odd) * sinKernel(Reduced);
+  return Res * (DoubleBatch(1.) - High * 2.);
+}
+
+// Lanes out of the range of the reduction go to the library function,
+// the others stay with the kernel: the value in a lane must not depend
+// on the other lanes of the batch, or the result of an integral would
+// depend on how the intervals were grouped.
+template <typename FuncTy>
+DoubleBatch sinOrCosLanewise(DoubleBatch X, bool isCos,
+                             const FuncTy &Fallback) {
+  if (X.allAbsNotGreater(MaxReducedArgument))
+    return sinOrCos(X, isCos);
+  constexpr auto Width = DoubleBatch::Width;
+  alignas(64) double Args[Width], Reduced[Width], Res[Width];
+  X.store(Args);
+  for (auto Lane = 0u; Lane < Width; ++Lane)
+    Reduced[Lane] =
+        std::abs(Args[Lane]) <= MaxReducedArgument ? Args[Lane] : 0;
+  sinOrCos(DoubleBatch::load(Reduced), isCos).store(Res);
+  for (auto Lane = 0u; Lane < Width; ++Lane)
+    if (!(std::abs(Args[Lane]) <= MaxReducedArgument))
+      Res[Lane] = Fallback(Args[Lane]);
+  return DoubleBatch::load(Res);
+}
+
+} // namespace SimdKernels
+
+inline double sin(double X) { return std::sin(X); }
+inline double cos(double X) { return std::cos(X); }
+
+inline DoubleBatch sin(DoubleBatch X) {
+  return SimdKernels::sinOrCosLanewise(X, /* isCos */ false, [](double Val) {
+    return std::sin(Val);
+  });
+}
+
+inline DoubleBatch cos(DoubleBatch X) {
+  return SimdKernels::sinOrCosLanewise(X, /* isCos */ true, [](double Val) {
+    return std::cos(Val);
+  });
+}
+
+// Integrand that can also be evaluated on a DoubleBatch. Such integrands
+// are integrated in the batched mode: several pending intervals are
+// refined together and the integrand is called on all their nodes at
+// once. Func is usually a generic lambda written with Integration::cos
+// and Integration::sin, so one body serves both cases.
+template <typename FuncTy> struct VectorizedFunction {
+  FuncTy Func;
+
+  double operator()(double X) const { return Func(X); }
+  DoubleBatch operator()(DoubleBatch X) const { return Func(X); }
+};
+
+template <typename FuncTy> VectorizedFunction<FuncTy> vectorized(FuncTy Func) {
+  return {std::move(Func)};
+}
+
+template <typename FuncTy> struct isVectorized : std::false_type {};
+template <typename FuncTy>
+struct isVectorized<VectorizedFunction<FuncTy>> : std::true_type {};
+
+// Values of Func in Count nodes. The last incomplete batch is padded with
+// the last node, so the integrand never sees garbage.
+template <typename FuncTy>
+void evaluateBatched(const VectorizedFunction<FuncTy> &Func,
+                     const double *Nodes, double *Values, unsigned Count) {
+  constexpr auto Width = DoubleBatch::Width;
+  auto Idx = 0u;
+  for (; Idx + Width <= Count; Idx += Width)
+    Func(DoubleBatch::load(Nodes + Idx)).store(Values + Idx);
+  if (Idx == Count)
+    return;
+  alignas(64) double Tail[Width];
+  for (auto Lane = 0u; Lane < Width; ++Lane)
+    Tail[Lane] = Nodes[std::min(Idx + Lane, Count - 1)];
+  Func(DoubleBatch::load(Tail)).store(Tail);
+  for (auto Lane = 0u; Idx + Lane < Count; ++Lane)
+    Values[Idx + Lane] = Tail[Lane];
+}
+
+} // namespace Integration
+
+#endif // SIMD_MATH_H
@@ -0,0 +1,229 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Integration {
+
+// How the threads of an Integrator are pinned to the processors:
+// None leaves them to the scheduler, Compact fills the cores of one L3
+// cache and one socket before the next ones, Scatter spreads them over
+// the sockets and the caches round-robin.
+enum class ThreadPlacement { None, Compact, Scatter };
+
+inline ThreadPlacement getThreadPlacement(const std::string &Name) {
+  if (Name == "none")
+    return ThreadPlacement::None;
+  if (Name == "compact")
+    return ThreadPlacement::Compact;
+  if (Name == "scatter")
+    return ThreadPlacement::Scatter;
+  throw std::logic_error("Unknown thread placement \"" + Name +
+                         "\", expected none, compact or scatter");
+}
+
+inline const char *getPlacementName(ThreadPlacement Placement) {
+  switch (Placement) {
+  case ThreadPlacement::Compact:
+    return "compact";
+  case ThreadPlacement::Scatter:
+    return "scatter";
+  default:
+    return "none";
+  }
+}
+
+// A logical processor. L3 is the smallest processor sharing the L3 cache
+// with it, so the caches of one socket are told apart.
+struct CpuLocation {
+  int Cpu = -1;
+  int Node = 0;
+  int Package = 0;
+  int L3 = 0;
+  int Core = 0;
+};
+
+// Steal tiers: victims sharing the L3 cache, sharing the socket or the
+// NUMA node, and the rest.
+#define COUNT_STEAL_TIERS 3
+
+inline unsigned getStealTier(const CpuLocation &Thief,
+                             const CpuLocation &Victim) {
+  if (Thief.Package == Victim.Package && Thief.L3 == Victim.L3)
+    return 0;
+  if (Thief.Package == Victim.Package || Thief.Node == Victim.Node)
+    return 1;
+  return 2;
+}
+
+// Where a thread of an Integrator runs and whom it robs first. The
+// location has Cpu -1 if the threads are not placed.
+struct WorkerPlacement {
+  CpuLocation Location;
+  bool isPinned = false;
+  // Other threads in the order of stealing, the tier T occupies
+  // [StealTierEnds[T - 1], StealTierEnds[T]).
+  std::vector<unsigned> StealOrder;
+  std::array<unsigned, COUNT_STEAL_TIERS> StealTierEnds{};
+};
+
+namespace Topology {
+
+// First number of a sysfs value, -1 if there is none.
+inline int readNumber(const std::filesystem::path &File) {
+  std::ifstream Stream{File};
+  int Value = -1;
+  Stream >> Value;
+  return Value;
+}
+
+inline CpuLocation readCpuLocation(int Cpu) {
+  namespace fs = std::filesystem;
+  fs::path CpuDir = "/sys/devices/system/cpu/cpu" + std::to_string(Cpu);
+  CpuLocation Location;
+  Location.Cpu = Cpu;
+  Location.Package =
+      std::max(readNumber(CpuDir / "topology" / "physical_package_id"), 0);
+  Location.Core = std::max(readNumber(CpuDir / "topology" / "core_id"), 0);
+  // Without the cache description the socket is taken for one cache.
+  Location.L3 = -1;
+  std::error_code Error;
+  for (auto &Entry : fs::directory_iterator(CpuDir / "cache", Error))
+    if (readNumber(Entry.path() / "level") == 3)
+      Location.L3 = readNumber(Entry.path() / "shared_cpu_list");
+  if (Location.L3 < 0)
+    Location.L3 = Location.Package;
+  for (auto &Entry : fs::directory_iterator(CpuDir, Error)) {
+    auto Name = Entry.path().filename().string();
+    if (Name.size() > 4 && Name.compare(0, 4, "node") == 0 &&
+        std::all_of(Name.begin() + 4, Name.end(),
+                    [](unsigned char C) { return std::isdigit(C); }))
+      Location.Node = std::stoi(Name.substr(4));
+  }
+  return Location;
+}
+
+// Processors the process may run on, empty if they are unknown.
+inline std::vector<CpuLocation> readCpus() {
+  std::vector<CpuLocation> Cpus;
+#ifdef __linux__
+  cpu_set_t Allowed;
+  CPU_ZERO(&Allowed);
+  if (sched_getaffinity(0, sizeof(Allowed), &Allowed) != 0)
+    return Cpus;
+  for (auto Cpu = 0; Cpu < CPU_SETSIZE; ++Cpu)
+    if (CPU_ISSET(Cpu, &Allowed))
+      Cpus.push_back(readCpuLocation(Cpu));
+#endif
+  return Cpus;
+}
+
+// Processors in the order they are given to the threads.
+inline std::vector<CpuLocation> orderCpus(std::vector<CpuLocation> Cpus,
+                                          ThreadPlacement Placement) {
+  auto getCompactKey = [](const CpuLocation &Location) {
+    return std::make_tuple(Location.Node, Location.Package, Location.L3,
+                           Location.Core, Location.Cpu);
+  };
+  std::sort(Cpus.begin(), Cpus.end(), [&](const auto &Lhs, const auto &Rhs) {
+    return getCompactKey(Lhs) < getCompactKey(Rhs);
+  });
+  if (Placement != ThreadPlacement::Scatter)
+    return Cpus;
+
+  // Number every processor among the hyper-threads of its core, the
+  // core within its cache, the cache within its socket, and deal the
+  // first hyper-threads of the cores round-robin over the sockets.
+  std::map<std::tuple<int, int, int>, int> SiblingsOfCore;
+  std::map<std::pair<int, int>, std::map<int, int>> CoresOfCache;
+  std::map<int, std::map<int, int>> CachesOfPackage;
+  std::vector<std::tuple<int, int, int, int, int>> Keys;
+  for (auto &Location : Cpus) {
+    auto &Cores = CoresOfCache[{Location.Package, Location.L3}];
+    auto &Caches = CachesOfPackage[Location.Package];
+    auto CoreIdx = Cores.emplace(Location.Core, Cores.size()).first->second;
+    auto CacheIdx = Caches.emplace(Location.L3, Caches.size()).first->second;
+    auto Sibling =
+        SiblingsOfCore[{Location.Package, Location.L3, Location.Core}]++;
+    Keys.emplace_back(Sibling, CoreIdx, CacheIdx, Location.Package,
+                      Location.Cpu);
+  }
+  std::vector<std::size_t> Order(Cpus.size());
+  for (auto Idx = 0u; Idx < Order.size(); ++Idx)
+    Order[Idx] = Idx;
+  std::sort(Order.begin(), Order.end(),
+            [&](auto Lhs, auto Rhs) { return Keys[Lhs] < Keys[Rhs]; });
+  std::vector<CpuLocation> Scattered;
+  for (auto Idx : Order)
+    Scattered.push_back(Cpus[Idx]);
+  return Scattered;
+}
+
+} // namespace Topology
+
+// Placement of CountThreads threads: their processors and the orders of
+// stealing, nearest victims first. If there are more threads than
+// processors, the processors are reused in the same order. Without
+// a placement all the other threads are in the last tier.
+inline std::vector<WorkerPlacement> placeThreads(unsigned CountThreads,
+                                                 ThreadPlacement Placement) {
+  std::vector<WorkerPlacement> Places(CountThreads);
+  std::vector<CpuLocation> Cpus;
+  if (Placement != ThreadPlacement::None)
+    Cpus = Topology::orderCpus(Topology::readCpus(), Placement);
+  for (auto Rank = 0u; Rank < CountThreads && !Cpus.empty(); ++Rank)
+    Places[Rank].Location = Cpus[Rank % Cpus.size()];
+
+  for (auto Rank = 0u; Rank < CountThreads; ++Rank) {
+    auto &Place = Places[Rank];
+    std::array<std::vector<unsigned>, COUNT_STEAL_TIERS> Tiers;
+    for (auto Victim = 0u; Victim < CountThreads; ++Victim) {
+      if (Victim == Rank)
+        continue;
+      auto Tier = Cpus.empty() ? COUNT_STEAL_TIERS - 1
+                               : getStealTier(Place.Location,
+                                              Places[Victim].Location);
+      Tiers[Tier].push_back(Victim);
+    }
+    for (auto Tier = 0u; Tier < COUNT_STEAL_TIERS; ++Tier) {
+      Place.StealOrder.insert(Place.StealOrder.end(), Tiers[Tier].begin(),
+                              Tiers[Tier].end());
+      Place.StealTierEnds[Tier] = Place.StealOrder.size();
+    }
+  }
+  return Places;
+}
+
+// Returns false if the thread can't be pinned to the processor.
+inline bool pinThread(std::thread &Thread, int Cpu) {
+#ifdef __linux__
+  if (Cpu < 0 || Cpu >= CPU_SETSIZE)
+    return false;
+  cpu_set_t Set;
+  CPU_ZERO(&Set);
+  CPU_SET(Cpu, &Set);
+  return pthread_setaffinity_np(Thread.native_handle(), sizeof(Set), &Set) ==
+         0;
+#else
+  return false;
+#endif
+}
+
+} // namespace Integration
+
+#endif // TOPOLOGY_H
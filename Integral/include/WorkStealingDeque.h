@@ -0,0 +1,115 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+namespace Integration {
+
+// Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli,
+// "Correct and Efficient Work-Stealing for Weak Memory Models").
+// The owner pushes and pops at the bottom, so it works depth-first on
+// the smallest intervals, while thieves take the oldest (largest)
+// interval from the top. Elements are trivially copyable, a torn read
+// of a slot only happens in a steal whose CAS then fails and the value
+// is discarded.
+template <typename T> class WorkStealingDeque {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  struct Array {
+    std::int64_t Capacity;
+    std::unique_ptr<T[]> Slots;
+
+    Array(std::int64_t Capacity)
+        : Capacity(Capacity), Slots(new T[Capacity]) {}
+    T get(std::int64_t Idx) const { return Slots[Idx & (Capacity - 1)]; }
+    void put(std::int64_t Idx, const T &Elem) {
+      Slots[Idx & (Capacity - 1)] = Elem;
+    }
+  };
+
+  alignas(64) std::atomic<std::int64_t> Top{0};
+  alignas(64) std::atomic<std::int64_t> Bottom{0};
+  std::atomic<Array *> Buffer;
+  // Retired buffers can still be read by a late thief, so they are
+  // released only together with the deque.
+  std::vector<std::unique_ptr<Array>> Buffers;
+
+public:
+  WorkStealingDeque(std::int64_t Capacity = DEQUE_INITIAL_CAPACITY) {
+    Buffers.emplace_back(new Array(Capacity));
+    Buffer.store(Buffers.back().get(), std::memory_order_relaxed);
+  }
+
+  bool empty() const {
+    return Bottom.load(std::memory_order_relaxed) <=
+           Top.load(std::memory_order_relaxed);
+  }
+
+  // Only the owner thread.
+  void push(const T &Elem) {
+    auto B = Bottom.load(std::memory_order_relaxed);
+    auto Tp = Top.load(std::memory_order_acquire);
+    auto *A = Buffer.load(std::memory_order_relaxed);
+    if (B - Tp > A->Capacity - 1)
+      A = grow(A, B, Tp);
+    A->put(B, Elem);
+    Bottom.store(B + 1, std::memory_order_release);
+  }
+
+  // Only the owner thread.
+  bool pop(T &Elem) {
+    auto B = Bottom.load(std::memory_order_relaxed) - 1;
+    auto *A = Buffer.load(std::memory_order_relaxed);
+    Bottom.store(B, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto Tp = Top.load(std::memory_order_relaxed);
+    if (Tp > B) {
+      // Deque was empty.
+      Bottom.store(B + 1, std::memory_order_relaxed);
+      return false;
+    }
+    Elem = A->get(B);
+    if (Tp == B) {
+      // The last element, race with thieves for it.
+      bool Won = Top.compare_exchange_strong(Tp, Tp + 1,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+      Bottom.store(B + 1, std::memory_order_relaxed);
+      return Won;
+    }
+    return true;
+  }
+
+  // Any thread.
+  bool steal(T &Elem) {
+    auto Tp = Top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto B = Bottom.load(std::memory_order_acquire);
+    if (Tp >= B)
+      return false;
+    auto *A = Buffer.load(std::memory_order_acquire);
+    Elem = A->get(Tp);
+    return Top.compare_exchange_strong(Tp, Tp + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed);
+  }
+
+private:
+  Array *grow(Array *Old, std::int64_t B, std::int64_t Tp) {
+    Buffers.emplace_back(new Array(Old->Capacity * 2));
+    auto *New = Buffers.back().get();
+    for (auto Idx = Tp; Idx < B; ++Idx)
+      New->put(Idx, Old->get(Idx));
+    Buffer.store(New, std::memory_order_release);
+    return New;
+  }
+};
+
+} // namespace Integration
+
+#endif // WORK_STEALING_DEQUE_H
@@ -2,106 +2,488 @@
 #define SUDOKU_H
 
 #include <algorithm>
-#include <bitset>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <omp.h>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
 
-#define MAX_NUM_SQUARES 64
+#include "SudokuBranching.h"
+#include "SudokuDLX.h"
+#include "SudokuMask.h"
+#include "SudokuStrategies.h"
+
+#define MAX_NUM_SQUARES 100
+// Sizes the solver is compiled for, X(Size) for each of them. A sudoku
+// takes the least one that fits it, so the boards of the square sizes
+// are laid out tight and copied fast.
+#define SOLVER_SIZES(X)                                                        \
+  X(9) X(16) X(25) X(36) X(49) X(64) X(81) X(MAX_NUM_SQUARES)
+// Default limit of the strategies in the search, checks per cell of the
+// board. Branching turned out cheaper than any strategy on the examples.
+#define SEARCH_STRATEGY_COST 0
+// The automatic choice of the engine takes the dancing links up to this
+// size of the sudoku. They were faster on all the examples but the empty
+// 64x64 board, where their order of the values runs into a dead end.
+#define DLX_MAX_NUM_SQUARES 49
+// Default heuristics of the backtracking, see getBranchHeuristics. The
+// backtracking is chosen for the boards above DLX_MAX_NUM_SQUARES, and
+// only lcv solves the empty 81x81 board. The degree led the empty 64x64
+// board into a dead end.
+#define SEARCH_BRANCHING "lcv"
+// Default limit of the search in seconds. Some boards above 49x49 are not
+// solved in hours, the search gives up on them and reports it.
+#define SEARCH_MAX_SECONDS 60
+// A thread of the search reads the clock once in this many values tried
+// or rows of the exact cover selected.
+#define SEARCH_CLOCK_PERIOD 256
 
 namespace SudokuGame {
 
 extern unsigned ThreadCount;
-extern bool SolutionFound;
 
 void failWithError(std::string Msg);
 
-static bool isInt(double Val) {
-  return abs(round(Val) - Val) < std::numeric_limits<double>::min();
-}
+// Kinds of the units: rows, columns and little squares. Every value is
+// used exactly once in every unit of a solved sudoku.
+#define COUNT_UNIT_KINDS 3
+enum UnitKind { RowUnit, ColumnUnit, LittleSquareUnit };
+
+enum class SolveStatus { Solved, Unsolvable, GaveUp };
+
+// Engines of the search after the humanistic algorithm: the backtracking
+// over the boards and the exact cover by the dancing links.
+enum class SolverEngine { Auto, Backtracking, DancingLinks };
+
+// Little squares of a sudoku with NumSquares values: the closest to a
+// square with no more rows than columns, 2x3 for 6x6 and 3x4 for 12x12.
+// One row for a prime size, such a sudoku is not supported.
+std::pair<unsigned, unsigned> getBoxShape(unsigned NumSquares);
+
+// Number of values of the sudoku given by its cells row by row, fails if
+// it is not a supported sudoku.
+unsigned getSudokuSize(const std::vector<int> &Array);
+
+// Engine by the name "auto", "backtracking" or "dlx".
+SolverEngine getEngine(const std::string &Name);
+
+struct SolverOptions {
+  // Strategies of the humanistic algorithm, see getStrategies.
+  std::string Strategies = "all";
+  // The strategies costing more than this many checks per cell are only
+  // used before the search.
+  unsigned SearchCost = SEARCH_STRATEGY_COST;
+  // Engine of the search, see getEngine.
+  std::string Engine = "auto";
+  // Heuristics of the backtracking, see getBranchHeuristics.
+  std::string Branching = SEARCH_BRANCHING;
+  // Seconds of the search before it gives up, 0 for no limit.
+  double MaxSeconds = SEARCH_MAX_SECONDS;
+};
 
+// Solver of a sudoku of any supported size, see makeSolver.
 class SudokuSolver {
+public:
+  virtual ~SudokuSolver() = default;
+
+  // Takes a new puzzle. The tables of the units are rebuilt only if the
+  // size changes, so one solver may be reused for many puzzles.
+  virtual void load(const std::vector<int> &Array) = 0;
+  virtual void setOptions(const SolverOptions &Options) = 0;
+
+  // Size of the sudoku loaded and the largest size of the solver.
+  virtual unsigned getNumSquares() const = 0;
+  virtual unsigned getMaxNumSquares() const = 0;
+  virtual void print() const = 0;
+  virtual void printSolved() const = 0;
+
+  // Solves with the threads of OpenMP.
+  virtual bool solve() = 0;
+  // Counts the solutions with the threads of OpenMP, a Limit not 0 stops
+  // the search as soon as that many are found.
+  virtual size_t countSolutions(size_t Limit = 0) = 0;
+  // True if the last solve or countSolutions stopped at the limit of
+  // SolverOptions::MaxSeconds, then its answer is not final.
+  virtual bool hasGivenUp() const = 0;
+  // The search stops at the second solution.
+  bool hasUniqueSolution() { return countSolutions(2) == 1; }
+  // Solves in the calling thread, gives up after MaxBoards boards are
+  // branched.
+  virtual SolveStatus solveAlone(size_t MaxBoards) = 0;
+  // Values of the solved grid row by row.
+  virtual void getSolution(std::vector<int> &Array) const = 0;
+};
+
+// Solver compiled for the least of the sizes SOLVER_SIZES not less than
+// NumSquares.
+std::unique_ptr<SudokuSolver> makeSolver(unsigned NumSquares);
+
+// Loads the puzzle to Solver. Solver is replaced by a new one with the
+// options if it is empty or compiled for another size, otherwise its
+// buffers are reused.
+void loadSolver(std::unique_ptr<SudokuSolver> &Solver,
+                const std::vector<int> &Array, const SolverOptions &Options);
+
+// Solver of the sudoku with up to MaxSquares values, the boards and the
+// masks are laid out for that size.
+template <unsigned MaxSquares> class SizedSolver final : public SudokuSolver {
 
 public:
-  struct Cell {
-    int Value = 0;
-    std::bitset<MAX_NUM_SQUARES> PossibleValues;
+  // Bit Val - 1 of a mask stands for the value Val.
+  using Mask = MaskFor<MaxSquares>;
+  static constexpr unsigned MaxNumCells = MaxSquares * MaxSquares;
+  // Index of a cell, the largest one stands for no cell.
+  using CellIdx = std::conditional_t<(MaxNumCells < 255), uint8_t, uint16_t>;
+  static constexpr CellIdx NoCell = CellIdx(-1);
+
+  // Empty cells of a board in doubly linked lists by the number of their
+  // possible values. A cell moves between the lists in O(1) as it loses
+  // values, the cell with the fewest is the head of the first list.
+  struct CellBuckets {
+    std::array<CellIdx, MaxSquares + 1> Heads;
+    std::array<CellIdx, MaxNumCells> Next;
+    std::array<CellIdx, MaxNumCells> Prev;
+    // Bit Count - 1 for every list of Count values that is not empty.
+    Mask NonEmpty;
+
+    void insert(unsigned Cell, unsigned Count) {
+      Prev[Cell] = NoCell;
+      Next[Cell] = Heads[Count];
+      if (Heads[Count] != NoCell)
+        Prev[Heads[Count]] = Cell;
+      Heads[Count] = Cell;
+      if (Count)
+        NonEmpty |= getBit<Mask>(Count - 1);
+    }
+
+    void remove(unsigned Cell, unsigned Count) {
+      if (Prev[Cell] != NoCell)
+        Next[Prev[Cell]] = Next[Cell];
+      else
+        Heads[Count] = Next[Cell];
+      if (Next[Cell] != NoCell)
+        Prev[Next[Cell]] = Prev[Cell];
+      if (Count && Heads[Count] == NoCell)
+        NonEmpty &= ~getBit<Mask>(Count - 1);
+    }
   };
 
+  // Trivially copyable, so a copy of a board is one memcpy. Possible
+  // values of an empty cell are the values not used in its row, column
+  // and little square and not excluded by the strategies.
   struct Board {
-    std::pair<int, int> CurrentIdx;
-    std::vector<std::vector<Cell>> Grid;
-
-    Board(const Board &Rhs);
-    Board() = default;
-    Board &operator=(const Board &Rhs) {
-      if (this == &Rhs)
-        return *this;
-
-      CurrentIdx = Rhs.CurrentIdx;
-      assert(!Rhs.Grid.empty());
-      auto Size = Rhs.Grid.size();
-      if (Grid.size())
-        Grid.clear();
-      Grid.resize(Size);
-      for (auto Row = 0; Row < Size; ++Row) {
-        Grid[Row].resize(Size);
-        Grid[Row] = Rhs.Grid[Row];
-      }
+    // Values of the cells row by row, 0 for an unfilled cell.
+    std::array<uint8_t, MaxNumCells> Values;
+    // Values used in every unit of every kind.
+    std::array<std::array<Mask, MaxSquares>, COUNT_UNIT_KINDS> Used;
+    // Values excluded from every cell.
+    std::array<Mask, MaxNumCells> Excluded;
+    // Kept only with the heuristic of the buckets.
+    CellBuckets Buckets;
+  };
 
-      return *this;
+  // Change of a board recorded to be undone: the value set to a cell or,
+  // if Value is 0, the values excluded from it.
+  struct Change {
+    uint16_t Cell;
+    uint8_t Value;
+    Mask Excluded;
+  };
+  using Trail = std::vector<Change>;
+
+  // Units whose cells lost possible values since they were checked for
+  // the singles last time. A unit is queued once however many values it
+  // lost.
+  struct UnitQueue {
+    std::array<Mask, COUNT_UNIT_KINDS> Units{};
+    // Changes of the board are recorded here if it is set.
+    Trail *Changes = nullptr;
+
+    void push(unsigned Kind, unsigned Unit) {
+      Units[Kind] |= getBit<Mask>(Unit);
+    }
+
+    bool pop(unsigned &Kind, unsigned &Unit) {
+      for (Kind = 0; Kind < COUNT_UNIT_KINDS; ++Kind)
+        if (Units[Kind]) {
+          Unit = getLowestBit(Units[Kind]);
+          clearLowestBit(Units[Kind]);
+          return true;
+        }
+      return false;
     }
   };
 
 private:
-  unsigned NumSquares;
-  unsigned LittleSqDim;
+  // Branches of the search not explored yet by a thread. The owner works
+  // at the back with the deepest branches, idle threads steal the
+  // shallowest ones, the largest subtrees, from the front.
+  struct BranchDeque {
+    std::mutex Mtx;
+    std::vector<Board> Boards;
+    size_t Front = 0;
+
+    void pushBack(const std::vector<Board> &Branches) {
+      std::lock_guard<std::mutex> LockMtx{Mtx};
+      Boards.insert(Boards.end(), Branches.begin(), Branches.end());
+    }
+
+    bool popBack(Board &Brd) {
+      std::lock_guard<std::mutex> LockMtx{Mtx};
+      if (Front == Boards.size())
+        return false;
+      Brd = Boards.back();
+      Boards.pop_back();
+      if (Front == Boards.size())
+        clear();
+      return true;
+    }
+
+    bool isEmpty() {
+      std::lock_guard<std::mutex> LockMtx{Mtx};
+      return Front == Boards.size();
+    }
+
+    bool popFront(Board &Brd) {
+      std::lock_guard<std::mutex> LockMtx{Mtx};
+      if (Front == Boards.size())
+        return false;
+      Brd = Boards[Front++];
+      if (Front == Boards.size())
+        clear();
+      return true;
+    }
+
+  private:
+    // Storage is reused, only the indices are reset.
+    void clear() {
+      Boards.clear();
+      Front = 0;
+    }
+  };
+
+  // Cell branched by the search in place: its values left to try, the
+  // next one at the back, and the length of the trail before them.
+  struct SearchFrame {
+    unsigned Cell;
+    unsigned CountLeft;
+    size_t Mark;
+    std::array<uint8_t, MaxSquares> Values;
+  };
+
+  // Search of a thread: the trail of the changes of its board and the
+  // cells branched on the way from the board it started with. The storage
+  // is reused from board to board, so the search does not allocate.
+  struct SearchPath {
+    Trail Changes;
+    std::vector<SearchFrame> Frames;
+    // Board of a shallower frame rebuilt to share its branches.
+    Board Spare;
+  };
+
+  unsigned NumSquares = 0;
+  // Little squares are BoxRows rows by BoxCols columns.
+  unsigned BoxRows = 0;
+  unsigned BoxCols = 0;
+  Mask AllValues;
+  // Cells of the unit Unit of the kind Kind start at
+  // (Kind * NumSquares + Unit) * NumSquares.
+  std::vector<uint16_t> UnitCells;
+  // Units of every kind containing a cell.
+  std::vector<std::array<uint8_t, COUNT_UNIT_KINDS>> CellUnits;
+  // Strategies of the humanistic algorithm from the cheapest one.
+  std::vector<Strategy> Strategies = getStrategies("all");
+  // Limit of the cost of the strategies per cell in the search.
+  unsigned SearchCost = SEARCH_STRATEGY_COST;
   Board OriginalGrid;
   Board SolvedGrid;
+  std::atomic<bool> isSolutionFound = false;
+  // Limit of the search in seconds, 0 for none.
+  double SearchMaxSeconds = SEARCH_MAX_SECONDS;
+  bool isGivenUp = false;
+  // Search of solveAlone, kept between the puzzles.
+  SearchPath AlonePath;
+  SolverEngine Engine = SolverEngine::Auto;
+  // Exact cover of the board left by the humanistic algorithm, its pool
+  // is kept between the puzzles.
+  DancingLinks Matrix;
+  BranchHeuristics Heuristics = getBranchHeuristics(SEARCH_BRANCHING);
 
 public:
-  SudokuSolver(const std::vector<int> &Array);
+  SizedSolver() = default;
+  SizedSolver(const std::vector<int> &Array) { load(Array); }
+
+  void load(const std::vector<int> &Array) override;
+
+  void setOptions(const SolverOptions &Options) override {
+    setStrategies(getStrategies(Options.Strategies));
+    SearchCost = Options.SearchCost;
+    Engine = getEngine(Options.Engine);
+    Heuristics = getBranchHeuristics(Options.Branching);
+    SearchMaxSeconds = Options.MaxSeconds;
+  }
+  // Engine for the current size, never Auto.
+  SolverEngine chooseEngine() const;
+  void setStrategies(const std::vector<Strategy> &NewStrategies);
 
   const Board &getOriginalGrid() const { return OriginalGrid; }
-  unsigned getNumSquares() const { return NumSquares; }
-  void print() const;
-  void printSolved() const;
+  unsigned getNumSquares() const override { return NumSquares; }
+  unsigned getMaxNumSquares() const override { return MaxSquares; }
+  void print() const override;
+  void printSolved() const override;
   void print(const Board &Brd) const;
   void printPossibleValues(const Board &Brd) const;
 
-  bool solve();
+  bool solve() override;
+  size_t countSolutions(size_t Limit = 0) override;
+  bool hasGivenUp() const override { return isGivenUp; }
+  SolveStatus solveAlone(size_t MaxBoards) override;
+  void getSolution(std::vector<int> &Array) const override;
 
 private:
-  bool isCorrectInput(const Board &Brd) const;
+  std::span<const uint16_t> getUnitCells(unsigned Kind, unsigned Unit) const {
+    return {UnitCells.data() + (Kind * NumSquares + Unit) * NumSquares,
+            NumSquares};
+  }
+
+  int getValue(const Board &Brd, int Row, int Col) const {
+    return Brd.Values[Row * NumSquares + Col];
+  }
+
+  Mask getPossibleValues(const Board &Brd, unsigned Cell) const {
+    if (Brd.Values[Cell])
+      return 0;
+    auto &Units = CellUnits[Cell];
+    return AllValues & ~(Brd.Used[RowUnit][Units[RowUnit]] |
+                         Brd.Used[ColumnUnit][Units[ColumnUnit]] |
+                         Brd.Used[LittleSquareUnit][Units[LittleSquareUnit]] |
+                         Brd.Excluded[Cell]);
+  }
 
-  void setValue(Board &Brd, int Row, int Col, int Value) const {
-    Brd.Grid[Row][Col].Value = Value;
+  void buildUnits();
+
+  // Calls onPeer(Peer) once for every other cell of the units of Cell.
+  template <typename Func> void forEachPeer(unsigned Cell, Func onPeer) const {
+    auto &Units = CellUnits[Cell];
+    for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+      for (auto Peer : getUnitCells(Kind, Units[Kind])) {
+        auto &PeerUnits = CellUnits[Peer];
+        // Cells of the little square in the row or column of Cell are
+        // visited with the line
+        if (Peer == Cell ||
+            (Kind == LittleSquareUnit &&
+             (PeerUnits[RowUnit] == Units[RowUnit] ||
+              PeerUnits[ColumnUnit] == Units[ColumnUnit])))
+          continue;
+        onPeer(Peer);
+      }
   }
 
-  void setPossibleValues(Board &Brd, int Row, int Col) const;
+  // Returns false if the value is already used in the row, column or
+  // little square.
+  bool setValue(Board &Brd, unsigned Cell, int Value) const;
 
-  bool reducePossibleValues(Board &Brd, int Row, int Col) const;
+  // Sets a possible value and queues the units of the cell and of its
+  // peers that lose the value.
+  void placeValue(Board &Brd, unsigned Cell, int Value,
+                  UnitQueue &Queue) const;
+
+  // Sets the singles of the queued units until the queue is empty: the
+  // only possible value of a cell, and the lone rangers, values possible
+  // in only one cell of a unit. Returns false on a contradiction: a cell
+  // or a value of a unit is left without possibilities.
+  bool propagate(Board &Brd, UnitQueue &Queue) const;
 
   // Humanistic alghorithm
   bool solveHumanistic(Board &Brd) const;
-  bool eliminate(Board &Brd) const;
-  bool setLoneRangersRow(Board &Brd) const;
-  bool setLoneRangersColumn(Board &Brd) const;
-  bool setLoneRangersLittleSquare(Board &Brd) const;
-  bool setTwinsRow(Board &Brd) const;
-  bool setTwinsColumn(Board &Brd) const;
+  // Propagates the queue and applies the strategies not more expensive
+  // than MaxCost until they find nothing. Returns false on a
+  // contradiction.
+  bool deduce(Board &Brd, UnitQueue &Queue, double MaxCost) const;
+  bool applyStrategy(Board &Brd, const Strategy &Strat,
+                     UnitQueue &Queue) const;
+  // Returns true if some of the values were possible in the cell.
+  bool excludeValues(Board &Brd, unsigned Cell, Mask Values,
+                     UnitQueue &Queue) const;
+  // Values of the units of the kind Kind possible only in one line of
+  // the kind LineKind.
+  bool excludeLocked(Board &Brd, unsigned Kind, unsigned LineKind,
+                     UnitQueue &Queue) const;
+  bool excludeNakedSubsets(Board &Brd, unsigned Size, UnitQueue &Queue) const;
+  bool excludeHiddenSubsets(Board &Brd, unsigned Size,
+                            UnitQueue &Queue) const;
+  bool excludeFish(Board &Brd, unsigned BaseKind, unsigned CoverKind,
+                   unsigned Size, UnitQueue &Queue) const;
 
   // Brute Force alghorithm
-  bool fillPermutationStack(Board &Brd);
-  bool solveBruteForce(Board &Brd);
+  // Enumerates the solutions with the threads of OpenMP, stops at Limit
+  // of them if it is not 0 or after SearchMaxSeconds. The first one found
+  // is kept in SolvedGrid.
+  size_t solveBruteForce(const Board &Brd, size_t Limit);
+  bool stealBranch(std::vector<BranchDeque> &Deques, unsigned Rank,
+                   unsigned CountThreads, Board &Brd) const;
+  // Sets the value to the cell and deduces from it, returns false on a
+  // contradiction. The changes are recorded to Changes if it is given.
+  bool tryValue(Board &Brd, unsigned Cell, int Value, Trail *Changes) const;
+  // Undoes the changes on the board from the last one.
+  void undoChanges(Board &Brd, std::span<const Change> Changes) const;
+  // Goes over the solutions below Brd depth first in place: the values
+  // are set on Brd and undone along the trail, no board is copied.
+  // onBranch() is called before every value tried and onSolution(Brd)
+  // with every solution, either of them stops the search returning
+  // false. Brd is restored unless the search is stopped.
+  template <typename OnBranch, typename OnSolution>
+  bool searchInPlace(Board &Brd, SearchPath &Path, OnBranch onBranch,
+                     OnSolution onSolution) const;
+  // Appends to Shared the boards of the values left in the shallowest
+  // frame of the path, Brd being the board of the deepest one. The frame
+  // has no values left then.
+  void shareBranches(const Board &Brd, SearchPath &Path,
+                     std::vector<Board> &Shared) const;
+
+  // Branching heuristics
+  // Puts the empty cells of the board to the buckets.
+  void initBuckets(Board &Brd) const;
+  // Moves a cell that had From possible values to the bucket of To of
+  // them.
+  void moveCell(Board &Brd, unsigned Cell, unsigned From, unsigned To) const {
+    Brd.Buckets.remove(Cell, From);
+    Brd.Buckets.insert(Cell, To);
+  }
+  // Empty cells of the units of the cell, the cell itself counted in
+  // each of them.
+  unsigned getDegree(const Board &Brd, unsigned Cell) const {
+    auto Degree = 0u;
+    for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+      Degree += NumSquares - countBits(Brd.Used[Kind][CellUnits[Cell][Kind]]);
+    return Degree;
+  }
+  // Empty cell with the fewest possible values, {NumSquares, NumSquares}
+  // if the board is filled.
   std::pair<int, int> getLeastUnsureCell(const Board &Brd) const;
-  void pushIdxPermutations(const std::pair<int, int> &Idx, Board Brd,
-                           std::vector<Board> *Stack) const;
+  // Writes the possible values of the cell in the order to try them, the
+  // first one at the back. Returns their number.
+  unsigned orderValues(const Board &Brd, unsigned Cell, uint8_t *Values) const;
+
+  // Dancing Links
+  // Rows of the matrix are the possible values of the empty cells,
+  // columns are the empty cells and the values missing in the units.
+  void buildExactCover(const Board &Brd);
+  // Sets the values of the rows of a cover.
+  void setCover(Board &Brd, const std::vector<int32_t> &Rows) const;
+  // Same as solveBruteForce, the threads take the rows of the first
+  // column.
+  size_t solveDancingLinks(const Board &Brd, size_t Limit);
 
 public:
   bool isSolved(const Board &Grid) const;
@@ -0,0 +1,49 @@
+#ifndef SUDOKU_BATCH_H
+#define SUDOKU_BATCH_H
+
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include "Sudoku.h"
+
+// Puzzles are read, solved and written by chunks of this size, the
+// solutions of a chunk are written in the order of the puzzles.
+#define BATCH_CHUNK_SIZE 4096
+// A thread gives up on a puzzle after branching this many boards, the
+// puzzle is solved by all the threads after the chunk.
+#define BATCH_MAX_BOARDS 2000
+// The text format has characters for the values up to 'Z', larger
+// puzzles are only read from json.
+#define BATCH_TEXT_MAX_NUM_SQUARES 35
+
+namespace SudokuGame {
+
+struct BatchReport {
+  size_t CountPuzzles = 0;
+  size_t CountSolved = 0;
+  size_t CountUnsolvable = 0;
+  size_t CountInvalid = 0;
+  // Puzzles solved by all the threads.
+  size_t CountHard = 0;
+  // Puzzles whose search stopped at SolverOptions::MaxSeconds.
+  size_t CountGaveUp = 0;
+  double Seconds = 0;
+  // Time of every puzzle in milliseconds.
+  std::vector<double> Latencies;
+
+  void print(std::ostream &Out);
+};
+
+// Solves the puzzles of In and writes the solutions to Out as they are
+// found. In is either text with a puzzle per line, N * N characters
+// '1'-'9', 'A'-'Z' for the values from 10 and '.' or '0' for the empty
+// cells, or a json array of arrays or of objects with the field
+// "sudoku". The solutions are written in the same format, "-" or null
+// for a puzzle without a solution.
+BatchReport solveBatch(std::istream &In, std::ostream &Out,
+                       const SolverOptions &Options = {});
+
+} // namespace SudokuGame
+
+#endif // SUDOKU_BATCH_H
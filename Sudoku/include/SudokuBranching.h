@@ -0,0 +1,31 @@
+#ifndef SUDOKU_BRANCHING_H
+#define SUDOKU_BRANCHING_H
+
+#include <string>
+
+namespace SudokuGame {
+
+// Heuristics of the backtracking over the boards: which empty cell is
+// branched and in which order its values are tried. The cell always has
+// the fewest possible values, the heuristics change how it is found and
+// how the ties are broken.
+struct BranchHeuristics {
+  // The boards keep their empty cells in buckets by the number of the
+  // possible values, so the cell is found in the first bucket that is
+  // not empty instead of by a scan of the board.
+  bool isBuckets = false;
+  // Ties go to the cell with the most empty cells in its units, the one
+  // constraining the rest of the board the most.
+  bool isDegree = false;
+  // Values are tried from the one possible in the fewest peers of the
+  // cell, the one leaving the most choices to them.
+  bool isLeastConstraining = false;
+};
+
+// Heuristics by names "buckets", "degree" and "lcv" separated by commas,
+// "all" for all of them and "none" for the plain scan of the board.
+BranchHeuristics getBranchHeuristics(const std::string &Names);
+
+} // namespace SudokuGame
+
+#endif // SUDOKU_BRANCHING_H
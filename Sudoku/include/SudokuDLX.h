@@ -0,0 +1,80 @@
+#ifndef SUDOKU_DLX_H
+#define SUDOKU_DLX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace SudokuGame {
+
+// Exact cover matrix of the Algorithm X with the dancing links. All the
+// nodes are in one flat pool and are referred to by indices: node 0 is
+// the root, nodes 1..CountColumns are the headers of the columns and the
+// rest are the ones of the rows. A copy of the matrix is a copy of the
+// pool, so every thread may search in its own copy.
+class DancingLinks {
+  struct Node {
+    int32_t Left, Right, Up, Down;
+    int32_t Column;
+    // Id of the row given to addRow, -1 for the headers.
+    int32_t Row;
+  };
+
+  std::vector<Node> Nodes;
+  // Rows left in every column.
+  std::vector<int32_t> Sizes;
+  // Rows selected by the search.
+  std::vector<int32_t> Selected;
+  // The search stops after this many selected rows if it is not 0.
+  size_t MaxSteps = 0;
+  size_t CountSteps = 0;
+  // The search stops at this moment of omp_get_wtime if it is not 0.
+  double Deadline = 0;
+  bool isLate = false;
+
+public:
+  // Called with the rows of every cover found, returns false to stop the
+  // search.
+  using CoverHandler = std::function<bool(const std::vector<int32_t> &)>;
+
+  // Empties the matrix, the memory of the pool is kept.
+  void reset(unsigned CountColumns, size_t CountRowNodes);
+  // Columns are numbered from 1.
+  void addRow(int32_t Row, std::span<const int32_t> Columns);
+
+  // Column with the fewest rows, 0 if all of them are covered.
+  int32_t chooseColumn() const;
+  // Nodes of the rows of a column, to split the search by them.
+  std::vector<int32_t> getColumnNodes(int32_t Column) const;
+  int32_t getColumnSize(int32_t Column) const { return Sizes[Column]; }
+
+  void cover(int32_t Column);
+  void uncover(int32_t Column);
+  // Takes the row of the node to the cover and covers its other columns.
+  void selectRow(int32_t RowNode);
+  void unselectRow(int32_t RowNode);
+
+  void setStepLimit(size_t Steps) {
+    MaxSteps = Steps;
+    CountSteps = 0;
+  }
+  bool isOutOfSteps() const { return MaxSteps && CountSteps >= MaxSteps; }
+  void setDeadline(double Moment) {
+    Deadline = Moment;
+    isLate = false;
+  }
+  bool isOutOfTime() const { return isLate; }
+
+  // Looks for the covers of the columns left. Returns false if it is
+  // stopped by onCover, by isStopped, by the limit of the steps or by the
+  // deadline.
+  bool search(const std::atomic<bool> &isStopped,
+              const CoverHandler &onCover);
+};
+
+} // namespace SudokuGame
+
+#endif // SUDOKU_DLX_H
@@ -0,0 +1,139 @@
+#ifndef SUDOKU_MASK_H
+#define SUDOKU_MASK_H
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+namespace SudokuGame {
+
+// Mask of Words 64-bit words for the sudoku with more than 64 values.
+template <unsigned Words> class WideMask {
+  std::array<uint64_t, Words> Bits{};
+
+public:
+  constexpr WideMask() = default;
+  constexpr WideMask(uint64_t Low) { Bits[0] = Low; }
+
+  explicit constexpr operator bool() const {
+    for (auto Word : Bits)
+      if (Word)
+        return true;
+    return false;
+  }
+  constexpr bool operator==(const WideMask &Other) const = default;
+
+  constexpr WideMask &operator&=(const WideMask &Other) {
+    for (auto Idx = 0u; Idx < Words; ++Idx)
+      Bits[Idx] &= Other.Bits[Idx];
+    return *this;
+  }
+  constexpr WideMask &operator|=(const WideMask &Other) {
+    for (auto Idx = 0u; Idx < Words; ++Idx)
+      Bits[Idx] |= Other.Bits[Idx];
+    return *this;
+  }
+  constexpr WideMask &operator^=(const WideMask &Other) {
+    for (auto Idx = 0u; Idx < Words; ++Idx)
+      Bits[Idx] ^= Other.Bits[Idx];
+    return *this;
+  }
+  friend constexpr WideMask operator&(WideMask Lhs, const WideMask &Rhs) {
+    return Lhs &= Rhs;
+  }
+  friend constexpr WideMask operator|(WideMask Lhs, const WideMask &Rhs) {
+    return Lhs |= Rhs;
+  }
+  friend constexpr WideMask operator^(WideMask Lhs, const WideMask &Rhs) {
+    return Lhs ^= Rhs;
+  }
+  constexpr WideMask operator~() const {
+    WideMask Result;
+    for (auto Idx = 0u; Idx < Words; ++Idx)
+      Result.Bits[Idx] = ~Bits[Idx];
+    return Result;
+  }
+
+  static constexpr WideMask getBit(unsigned Idx) {
+    WideMask Result;
+    Result.Bits[Idx / 64] = uint64_t{1} << Idx % 64;
+    return Result;
+  }
+  constexpr int count() const {
+    int Count = 0;
+    for (auto Word : Bits)
+      Count += std::popcount(Word);
+    return Count;
+  }
+  // The mask must not be empty.
+  constexpr unsigned getLowest() const {
+    for (auto Idx = 0u; Idx < Words; ++Idx)
+      if (Bits[Idx])
+        return Idx * 64 + std::countr_zero(Bits[Idx]);
+    assert(false && "The lowest bit of an empty mask");
+    __builtin_unreachable();
+  }
+  constexpr void clearLowest() {
+    for (auto &Word : Bits)
+      if (Word) {
+        Word &= Word - 1;
+        return;
+      }
+  }
+};
+
+// The least mask for Size values: 16, 32 and 64 bits, then the words.
+template <unsigned Size>
+using MaskFor = std::conditional_t<
+    Size <= 16, uint16_t,
+    std::conditional_t<
+        Size <= 32, uint32_t,
+        std::conditional_t<Size <= 64, uint64_t, WideMask<(Size + 63) / 64>>>>;
+
+// Operations on the masks of both kinds. The bit Idx of a mask stands
+// for the value Idx + 1 or for the unit, cell or line Idx.
+template <typename Mask> constexpr Mask getBit(unsigned Idx) {
+  if constexpr (std::is_integral_v<Mask>)
+    return Mask(Mask{1} << Idx);
+  else
+    return Mask::getBit(Idx);
+}
+
+template <typename Mask> constexpr Mask getLowBits(unsigned Count) {
+  Mask Result{0};
+  for (auto Idx = 0u; Idx < Count; ++Idx)
+    Result |= getBit<Mask>(Idx);
+  return Result;
+}
+
+template <typename Mask> constexpr bool hasBit(Mask Bits, unsigned Idx) {
+  return bool(Bits & getBit<Mask>(Idx));
+}
+
+template <typename Mask> constexpr int countBits(Mask Bits) {
+  if constexpr (std::is_integral_v<Mask>)
+    return std::popcount(Bits);
+  else
+    return Bits.count();
+}
+
+// Index of the lowest bit set, Bits must not be empty.
+template <typename Mask> constexpr unsigned getLowestBit(Mask Bits) {
+  if constexpr (std::is_integral_v<Mask>)
+    return std::countr_zero(Bits);
+  else
+    return Bits.getLowest();
+}
+
+template <typename Mask> constexpr void clearLowestBit(Mask &Bits) {
+  if constexpr (std::is_integral_v<Mask>)
+    Bits &= Bits - 1;
+  else
+    Bits.clearLowest();
+}
+
+} // namespace SudokuGame
+
+#endif // SUDOKU_MASK_H
@@ -0,0 +1,48 @@
+#ifndef SUDOKU_STRATEGIES_H
+#define SUDOKU_STRATEGIES_H
+
+#include <string>
+#include <vector>
+
+namespace SudokuGame {
+
+// Deductions of the humanistic algorithm beyond the singles. They only
+// exclude values from the cells, the singles then set the values.
+enum class StrategyKind {
+  // A value of a little square possible only in one row or column of it
+  // is excluded from the rest of the line.
+  Pointing,
+  // A value of a row or column possible only in one little square is
+  // excluded from the rest of the square.
+  BoxLine,
+  // Size cells of a unit with Size possible values together: the values
+  // are excluded from the other cells of the unit.
+  NakedSubset,
+  // Size values of a unit possible only in Size cells of it: the other
+  // values are excluded from these cells.
+  HiddenSubset,
+  // A value possible in Size rows only in Size columns: it is excluded
+  // from the other cells of the columns, and the same with the rows and
+  // the columns swapped. X-Wing for the size 2, Swordfish for 3.
+  Fish
+};
+
+struct Strategy {
+  const char *Name;
+  StrategyKind Kind;
+  unsigned Size;
+  // Checks of one pass over a board, see getStrategyCost.
+  double Cost = 0;
+};
+
+// Estimate of the checks of one pass of the strategy over a board with
+// NumSquares values, the cheaper strategies are tried first.
+double getStrategyCost(const Strategy &Strat, unsigned NumSquares);
+
+// Strategies by names separated by commas, "all" for all of them and
+// "none" for the singles only.
+std::vector<Strategy> getStrategies(const std::string &Names);
+
+} // namespace SudokuGame
+
+#endif // SUDOKU_STRATEGIES_H
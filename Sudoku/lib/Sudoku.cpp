@@ -1,98 +1,110 @@
-#include "Sudoku.h"
+#include <thread>
+#include <tuple>
 
-#define STACK_SIZE 20
+#include "Sudoku.h"
 
 namespace SudokuGame {
 
-std::vector<SudokuSolver::Board> PermutationsStack;
-
 void failWithError(std::string Msg) { throw std::logic_error(Msg); }
 
-SudokuSolver::Board::Board(const Board &Rhs) {
-  auto NumSquares = Rhs.Grid.size();
-  Grid.resize(NumSquares);
-  for (auto Row = 0u; Row < NumSquares; ++Row) {
-    Grid[Row].resize(NumSquares);
-    for (auto Col = 0u; Col < NumSquares; ++Col) {
-      Grid[Row][Col].Value = Rhs.Grid[Row][Col].Value;
-      Grid[Row][Col].PossibleValues = Rhs.Grid[Row][Col].PossibleValues;
-    }
-  }
+std::pair<unsigned, unsigned> getBoxShape(unsigned NumSquares) {
+  unsigned Rows = std::sqrt(NumSquares);
+  while (Rows > 1 && NumSquares % Rows)
+    --Rows;
+  return {Rows, NumSquares / std::max(Rows, 1u)};
 }
 
-SudokuSolver::SudokuSolver(const std::vector<int> &Array) {
-  const auto &Squares = sqrt(Array.size());
-  if (!isInt(sqrt(Squares)))
+unsigned getSudokuSize(const std::vector<int> &Array) {
+  unsigned Squares = std::lround(std::sqrt(Array.size()));
+  if (Array.empty() || Squares * Squares != Array.size())
     failWithError("Введённый массив судоку не является");
-  if (!std::all_of(Array.begin(), Array.end(),
-                   [Squares](const auto &Elem) { return Elem <= Squares; }))
-    failWithError("Элементы массива не удовлетворяют правилам судоку");
-
-  NumSquares = Squares;
-  LittleSqDim = int(sqrt(Squares));
-
-  OriginalGrid.Grid.resize(NumSquares);
-  for (auto Elem = 0u, Row = 0u; Row < NumSquares; ++Row) {
-    OriginalGrid.Grid[Row].resize(NumSquares);
-    for (auto Col = 0u; Col < NumSquares; ++Col, ++Elem)
-      setValue(OriginalGrid, Row, Col, Array[Elem]);
-  }
-  if (!isCorrectInput(OriginalGrid))
-    failWithError("Некорректное начальное судоку");
+  if (Squares > MAX_NUM_SQUARES)
+    failWithError("Размер судоку больше " + std::to_string(MAX_NUM_SQUARES));
+  if (getBoxShape(Squares).first < 2)
+    failWithError("Судоку " + std::to_string(Squares) + "x" +
+                  std::to_string(Squares) + " не делится на малые квадраты");
+  return Squares;
 }
 
-bool SudokuSolver::isCorrectInput(const Board &Brd) const {
-  std::vector<bool> ValuesBeen(NumSquares, false);
-
-  auto clearValuesBeen = [&]() {
-    ValuesBeen.clear();
-    ValuesBeen.resize(NumSquares, false);
-  };
+SolverEngine getEngine(const std::string &Name) {
+  if (Name == "auto")
+    return SolverEngine::Auto;
+  if (Name == "backtracking")
+    return SolverEngine::Backtracking;
+  if (Name == "dlx")
+    return SolverEngine::DancingLinks;
+  failWithError("Unknown engine \"" + Name + "\"");
+  return SolverEngine::Auto;
+}
 
-  auto checkRowCol = [&](auto Row, auto Col) {
-    auto Value = Brd.Grid[Row][Col].Value;
-    if (Value == 0)
-      return true;
-    if (ValuesBeen[Value - 1] == true)
-      return false;
-    ValuesBeen[Value - 1] = true;
-    return true;
-  };
+template <unsigned MaxSquares>
+SolverEngine SizedSolver<MaxSquares>::chooseEngine() const {
+  if (Engine != SolverEngine::Auto)
+    return Engine;
+  return NumSquares <= DLX_MAX_NUM_SQUARES ? SolverEngine::DancingLinks
+                                           : SolverEngine::Backtracking;
+}
 
-  // Check rows
-  for (auto Row = 0; Row < NumSquares; ++Row) {
-    for (auto Col = 0; Col < NumSquares; ++Col)
-      if (!checkRowCol(Row, Col))
-        return false;
-    clearValuesBeen();
-  }
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::load(const std::vector<int> &Array) {
+  auto Squares = getSudokuSize(Array);
+  if (Squares > MaxSquares)
+    failWithError("Размер судоку больше " + std::to_string(MaxSquares));
+  if (!std::all_of(Array.begin(), Array.end(), [Squares](const auto &Elem) {
+        return Elem >= 0 && Elem <= int(Squares);
+      }))
+    failWithError("Элементы массива не удовлетворяют правилам судоку");
 
-  // Check columns
-  for (auto Col = 0; Col < NumSquares; ++Col) {
-    for (auto Row = 0; Row < NumSquares; ++Row)
-      if (!checkRowCol(Row, Col))
-        return false;
-    clearValuesBeen();
+  OriginalGrid = Board{};
+  if (NumSquares != Squares) {
+    NumSquares = Squares;
+    std::tie(BoxRows, BoxCols) = getBoxShape(NumSquares);
+    AllValues = getLowBits<Mask>(NumSquares);
+    buildUnits();
+    // The costs depend on the size
+    setStrategies(Strategies);
   }
+  for (auto Cell = 0u; Cell < NumSquares * NumSquares; ++Cell)
+    if (Array[Cell] && !setValue(OriginalGrid, Cell, Array[Cell]))
+      failWithError("Некорректное начальное судоку");
+}
 
-  if (!ValuesBeen.empty())
-    ValuesBeen.clear();
-  ValuesBeen.resize(NumSquares, false);
-  // Check little squares
-  for (auto SqRow = 0; SqRow < NumSquares; SqRow = SqRow + LittleSqDim) {
-    for (auto SqCol = 0; SqCol < NumSquares; SqCol = SqCol + LittleSqDim) {
-      for (auto Row = SqRow; Row < SqRow + LittleSqDim; ++Row) {
-        for (auto Col = SqCol; Col < SqCol + LittleSqDim; ++Col)
-          if (!checkRowCol(Row, Col))
-            return false;
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::buildUnits() {
+  UnitCells.resize(COUNT_UNIT_KINDS * NumSquares * NumSquares);
+  CellUnits.resize(NumSquares * NumSquares);
+  std::vector<unsigned> UnitSizes(COUNT_UNIT_KINDS * NumSquares, 0);
+  for (auto Row = 0u; Row < NumSquares; ++Row)
+    for (auto Col = 0u; Col < NumSquares; ++Col) {
+      auto Cell = Row * NumSquares + Col;
+      auto &Units = CellUnits[Cell];
+      Units[RowUnit] = Row;
+      Units[ColumnUnit] = Col;
+      Units[LittleSquareUnit] =
+          Row / BoxRows * BoxRows + Col / BoxCols;
+      for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind) {
+        auto Unit = Kind * NumSquares + Units[Kind];
+        UnitCells[Unit * NumSquares + UnitSizes[Unit]++] = Cell;
       }
-      clearValuesBeen();
     }
-  }
+}
+
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::setValue(Board &Brd, unsigned Cell,
+                                       int Value) const {
+  auto Bit = getBit<Mask>(Value - 1);
+  auto &Units = CellUnits[Cell];
+  for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+    if (Brd.Used[Kind][Units[Kind]] & Bit)
+      return false;
+  for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+    Brd.Used[Kind][Units[Kind]] |= Bit;
+  Brd.Values[Cell] = Value;
   return true;
 }
 
-bool SudokuSolver::isSolved(const Board &Grid) const {
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::isSolved(const Board &Grid) const {
   std::vector<bool> ValuesBeen(NumSquares, false);
 
   auto clearValuesBeen = [&]() {
@@ -101,7 +113,7 @@ bool SudokuSolver::isSolved(const Board &Grid) const {
   };
 
   auto checkLess = [&](auto Row, auto Col) {
-    auto Value = Grid.Grid[Row][Col].Value;
+    auto Value = getValue(Grid, Row, Col);
     if (ValuesBeen[Value - 1] == true)
       failWithError("Repeat value " + std::to_string(Value) + " on " +
                     std::to_string(Row) + " row, col or little square");
@@ -109,37 +121,37 @@ bool SudokuSolver::isSolved(const Board &Grid) const {
     return true;
   };
   auto checkRowCol = [&](auto Row, auto Col) {
-    auto Value = Grid.Grid[Row][Col].Value;
+    auto Value = getValue(Grid, Row, Col);
     if (Value == 0)
       return /* Cell unfilled */ false;
-    if (OriginalGrid.Grid[Row][Col].Value &&
-        (Value != OriginalGrid.Grid[Row][Col].Value))
+    auto OriginalValue = getValue(OriginalGrid, Row, Col);
+    if (OriginalValue && (Value != OriginalValue))
       failWithError("Value in (" + std::to_string(Row) + ", " +
                     std::to_string(Col) + ") cell differ from original matrix");
     return checkLess(Row, Col);
   };
 
   // Check rows
-  for (auto Row = 0; Row < NumSquares; ++Row) {
-    for (auto Col = 0; Col < NumSquares; ++Col)
+  for (auto Row = 0u; Row < NumSquares; ++Row) {
+    for (auto Col = 0u; Col < NumSquares; ++Col)
       if (!checkRowCol(Row, Col))
         return false;
     clearValuesBeen();
   }
 
   // Check columns
-  for (auto Col = 0; Col < NumSquares; ++Col) {
-    for (auto Row = 0; Row < NumSquares; ++Row)
+  for (auto Col = 0u; Col < NumSquares; ++Col) {
+    for (auto Row = 0u; Row < NumSquares; ++Row)
       if (!checkLess(Row, Col))
         return false;
     clearValuesBeen();
   }
 
   // Check little squares
-  for (auto SqRow = 0; SqRow < NumSquares; SqRow = SqRow + LittleSqDim) {
-    for (auto SqCol = 0; SqCol < NumSquares; SqCol = SqCol + LittleSqDim) {
-      for (auto Row = SqRow; Row < SqRow + LittleSqDim; ++Row) {
-        for (auto Col = SqCol; Col < SqCol + LittleSqDim; ++Col)
+  for (auto SqRow = 0u; SqRow < NumSquares; SqRow = SqRow + BoxRows) {
+    for (auto SqCol = 0u; SqCol < NumSquares; SqCol = SqCol + BoxCols) {
+      for (auto Row = SqRow; Row < SqRow + BoxRows; ++Row) {
+        for (auto Col = SqCol; Col < SqCol + BoxCols; ++Col)
           if (!checkLess(Row, Col))
             return false;
       }
@@ -149,21 +161,23 @@ bool SudokuSolver::isSolved(const Board &Grid) const {
   return true;
 }
 
-void SudokuSolver::print(const Board &Brd) const {
-  for (auto Row = 0; Row < NumSquares; ++Row) {
-    for (auto Col = 0; Col < NumSquares; ++Col) {
-      std::cout << Brd.Grid[Row][Col].Value;
-      if (Brd.Grid[Row][Col].Value / 10u == 0)
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::print(const Board &Brd) const {
+  for (auto Row = 0u; Row < NumSquares; ++Row) {
+    for (auto Col = 0u; Col < NumSquares; ++Col) {
+      std::cout << getValue(Brd, Row, Col);
+      if (getValue(Brd, Row, Col) / 10u == 0)
         std::cout << "  ";
       else
         std::cout << " ";
-      if ((Col + 1) % LittleSqDim == 0 && Col < NumSquares - 1)
+      if ((Col + 1) % BoxCols == 0 && Col < NumSquares - 1)
         std::cout << "| ";
     }
     std::cout << "\n";
-    if ((Row + 1) % LittleSqDim == 0 && Row < NumSquares - 1) {
-      for (auto Idx = 0u; Idx <= NumSquares + 1; ++Idx)
-        if ((Idx + 1) % (LittleSqDim + 1) == 0)
+    if ((Row + 1) % BoxRows == 0 && Row < NumSquares - 1) {
+      // Cells and separators of a row
+      for (auto Idx = 0u; Idx < NumSquares + NumSquares / BoxCols - 1; ++Idx)
+        if ((Idx + 1) % (BoxCols + 1) == 0)
           std::cout << "+-";
         else
           std::cout << "---";
@@ -172,457 +186,421 @@ void SudokuSolver::print(const Board &Brd) const {
   }
 }
 
-void SudokuSolver::printPossibleValues(const Board &Brd) const {
-  for (auto Row = 0; Row < NumSquares; ++Row) {
-    for (auto Col = 0; Col < NumSquares; ++Col) {
-      std::cout << Brd.Grid[Row][Col].Value << " ";
-      std::cout << "Possible values: (" << Brd.Grid[Row][Col].PossibleValues
-                << ") ";
-      if ((Col + 1) % LittleSqDim == 0 && Col < NumSquares - 1)
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::printPossibleValues(const Board &Brd) const {
+  for (auto Row = 0u; Row < NumSquares; ++Row) {
+    for (auto Col = 0u; Col < NumSquares; ++Col) {
+      std::cout << getValue(Brd, Row, Col) << " ";
+      std::cout << "Possible values: (";
+      auto PossibleVals = getPossibleValues(Brd, Row * NumSquares + Col);
+      for (auto Val = NumSquares; Val-- > 0;)
+        std::cout << hasBit(PossibleVals, Val);
+      std::cout << ") ";
+      if ((Col + 1) % BoxCols == 0 && Col < NumSquares - 1)
         std::cout << "| ";
     }
     std::cout << "\n";
-    if ((Row + 1) % LittleSqDim == 0 && Row < NumSquares - 1)
+    if ((Row + 1) % BoxRows == 0 && Row < NumSquares - 1)
       std::cout << "------+-------+-------\n";
   }
 }
 
-void SudokuSolver::print() const { print(OriginalGrid); }
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::print() const {
+  print(OriginalGrid);
+}
 
-void SudokuSolver::printSolved() const {
-  assert(!SolvedGrid.Grid.empty());
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::printSolved() const {
+  assert(getValue(SolvedGrid, 0, 0));
   print(SolvedGrid);
 }
 
-static unsigned whichSet(const auto &Bitset, unsigned Count) {
-  for (auto Bit = 0; Bit < Count; ++Bit)
-    if (Bitset[Bit])
-      return Bit + 1;
-  failWithError("None set");
-  return 0;
+template <typename Mask> static unsigned whichSet(Mask Bits) {
+  if (!Bits)
+    failWithError("None set");
+  return getLowestBit(Bits) + 1;
 }
 
-bool SudokuSolver::eliminate(Board &Brd) const {
-  int IsChange = false;
-  for (auto Row = 0; Row < NumSquares; ++Row) {
-    for (auto Col = 0; Col < NumSquares; ++Col) {
-      auto PossibleVals = Brd.Grid[Row][Col].PossibleValues;
-      if (Brd.Grid[Row][Col].Value == 0 && PossibleVals.count() == 1) {
-        IsChange = true;
-        Brd.Grid[Row][Col].Value = whichSet(PossibleVals, NumSquares);
-        if (!reducePossibleValues(Brd, Row, Col))
-          failWithError("Eleminate end bad");
-      }
-    }
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::placeValue(Board &Brd, unsigned Cell, int Value,
+                                         UnitQueue &Queue) const {
+  auto Bit = getBit<Mask>(Value - 1);
+  if (Heuristics.isBuckets) {
+    Brd.Buckets.remove(Cell, countBits(getPossibleValues(Brd, Cell)));
+    forEachPeer(Cell, [&](unsigned Peer) {
+      auto PeerVals = getPossibleValues(Brd, Peer);
+      if (PeerVals & Bit)
+        moveCell(Brd, Peer, countBits(PeerVals), countBits(PeerVals) - 1);
+    });
   }
-  return IsChange;
+  // The cell is among the peers, its units lose all its possible values.
+  for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+    for (auto Peer : getUnitCells(Kind, CellUnits[Cell][Kind]))
+      if (getPossibleValues(Brd, Peer) & Bit)
+        for (auto PeerKind = 0u; PeerKind < COUNT_UNIT_KINDS; ++PeerKind)
+          Queue.push(PeerKind, CellUnits[Peer][PeerKind]);
+  setValue(Brd, Cell, Value);
+  if (Queue.Changes)
+    Queue.Changes->push_back({uint16_t(Cell), uint8_t(Value), 0});
 }
 
-bool SudokuSolver::setLoneRangersRow(Board &Brd) const {
-  auto IsChange = false, ResultChange = false;
-
-  // Repeat if changed
-  do {
-    IsChange = false;
-    for (auto Row = 0; Row < NumSquares; ++Row) {
-      for (auto Val = 0u; Val < NumSquares; ++Val) {
-        int CountVals = 0u;
-        int RowLR, ColLR;
-        // Find in current row
-        for (auto Col = 0; Col < NumSquares; ++Col) {
-          if (Brd.Grid[Row][Col].Value == 0 &&
-              (Brd.Grid[Row][Col].PossibleValues[Val])) {
-            ++CountVals;
-            if (CountVals > 1)
-              break;
-
-            RowLR = Row;
-            ColLR = Col;
-          }
-        }
-
-        if (CountVals == 1) {
-          // This value possible only in one cell in row. Set it.
-          Brd.Grid[RowLR][ColLR].Value = Val + 1;
-          reducePossibleValues(Brd, RowLR, ColLR);
-
-          IsChange = true;
-          ResultChange = true;
-        }
-      }
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::propagate(Board &Brd, UnitQueue &Queue) const {
+  unsigned Kind, Unit;
+  while (Queue.pop(Kind, Unit)) {
+    auto Cells = getUnitCells(Kind, Unit);
+    // Values possible in at least one and in at least two cells
+    Mask Once = 0, Twice = 0;
+    for (auto Cell : Cells) {
+      auto PossibleVals = getPossibleValues(Brd, Cell);
+      if (!PossibleVals && !Brd.Values[Cell])
+        return /* No possible values */ false;
+      Twice |= Once & PossibleVals;
+      Once |= PossibleVals;
     }
-  } while (IsChange);
-  return ResultChange;
+    if ((Once | Brd.Used[Kind][Unit]) != AllValues)
+      return /* No place for a value */ false;
+
+    // Placements queue the unit again, so the masks may be stale here:
+    // a lone ranger may only have lost its cell, which is found then.
+    Mask LoneRangers = Once & ~Twice;
+    for (auto Cell : Cells) {
+      auto PossibleVals = getPossibleValues(Brd, Cell);
+      Mask Singles = countBits(PossibleVals) == 1 ? PossibleVals
+                                                  : PossibleVals & LoneRangers;
+      if (!Singles)
+        continue;
+      if (countBits(Singles) > 1)
+        return /* Two lone rangers in one cell */ false;
+      placeValue(Brd, Cell, whichSet(Singles), Queue);
+    }
+  }
+  return true;
 }
 
-bool SudokuSolver::setLoneRangersColumn(Board &Brd) const {
-  auto IsChange = false, ResultChange = false;
-
-  // Repeat if changed
-  do {
-    IsChange = false;
-    for (auto Col = 0; Col < NumSquares; ++Col) {
-      for (auto Val = 0u; Val < NumSquares; ++Val) {
-        int CountVals = 0u;
-        int RowLR, ColLR;
-        // Find in current col
-        for (auto Row = 0; Row < NumSquares; ++Row) {
-          if (Brd.Grid[Row][Col].Value == 0 &&
-              (Brd.Grid[Row][Col].PossibleValues[Val])) {
-            ++CountVals;
-            if (CountVals > 1)
-              break;
-
-            RowLR = Row;
-            ColLR = Col;
-          }
-        }
-
-        if (CountVals == 1) {
-          // This value possible only in one cell in row. Set it.
-          Brd.Grid[RowLR][ColLR].Value = Val + 1;
-          if (!reducePossibleValues(Brd, RowLR, ColLR))
-            failWithError("Lone ranger row end bad");
-
-          IsChange = true;
-          ResultChange = true;
-        }
-      }
-    }
-  } while (IsChange);
-  return ResultChange;
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::solveHumanistic(Board &Brd) const {
+  UnitQueue Queue;
+  for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+    for (auto Unit = 0u; Unit < NumSquares; ++Unit)
+      Queue.push(Kind, Unit);
+  return deduce(Brd, Queue, std::numeric_limits<double>::infinity());
+}
 
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::stealBranch(std::vector<BranchDeque> &Deques,
+                                          unsigned Rank, unsigned CountThreads,
+                                          Board &Brd) const {
+  for (auto Shift = 1u; Shift < CountThreads; ++Shift)
+    if (Deques[(Rank + Shift) % CountThreads].popFront(Brd))
+      return true;
   return false;
 }
 
-bool SudokuSolver::setLoneRangersLittleSquare(Board &Brd) const {
-  auto IsChange = false, ResultChange = false;
-
-  // Repeat if changed
-  do {
-    IsChange = false;
-    for (auto Val = 0u; Val < NumSquares; ++Val) {
-      for (auto SqRow = 0; SqRow < NumSquares; SqRow += LittleSqDim) {
-        for (auto SqCol = 0; SqCol < NumSquares; SqCol += LittleSqDim) {
-          int CountVals = 0u;
-          int RowLR, ColLR;
-          // Find in current little square
-          for (auto Row = SqRow; Row < SqRow + LittleSqDim; ++Row) {
-            for (auto Col = 0; Col < SqCol + LittleSqDim; ++Col) {
-              if (Brd.Grid[Row][Col].Value == 0 &&
-                  (Brd.Grid[Row][Col].PossibleValues[Val])) {
-                ++CountVals;
-                if (CountVals > 1)
-                  break;
-
-                RowLR = Row;
-                ColLR = Col;
-              }
-            }
-            if (CountVals > 1)
-              break;
-          }
-
-          if (CountVals == 1) {
-            // This value possible only in one cell in row. Set it.
-            Brd.Grid[RowLR][ColLR].Value = Val + 1;
-            if (!reducePossibleValues(Brd, RowLR, ColLR))
-              failWithError("Lone ranger little square end bad");
-
-            IsChange = true;
-            ResultChange = true;
-          }
-        }
-      }
-    }
-  } while (IsChange);
-  return ResultChange;
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::tryValue(Board &Brd, unsigned Cell, int Value,
+                                       Trail *Changes) const {
+  UnitQueue Queue;
+  Queue.Changes = Changes;
+  placeValue(Brd, Cell, Value, Queue);
+  return deduce(Brd, Queue, double(SearchCost) * NumSquares * NumSquares);
 }
 
-bool SudokuSolver::setTwinsRow(Board &Brd) const {
-  auto IsChange = false;
-  for (auto Row = 0; Row < NumSquares; ++Row) {
-    for (auto Col = 0u; Col < NumSquares; ++Col) {
-      auto PossibleVals = Brd.Grid[Row][Col].PossibleValues;
-      if (PossibleVals.count() == 2) {
-        // Find twin
-        for (auto ColTw = Col + 1; ColTw < NumSquares; ++ColTw) {
-          if (PossibleVals == Brd.Grid[Row][ColTw].PossibleValues) {
-            // Remove the pair of possible values from all unset cells in row
-            for (auto ColRem = 0; ColRem < NumSquares; ++ColRem) {
-              if (ColRem != Col && ColRem != ColTw &&
-                  Brd.Grid[Row][ColRem].Value == 0 &&
-                  (Brd.Grid[Row][ColRem].PossibleValues & PossibleVals).any()) {
-                Brd.Grid[Row][ColRem].PossibleValues &= ~PossibleVals;
-                IsChange = true;
-              }
-            }
-          }
-        }
-      }
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::undoChanges(
+    Board &Brd, std::span<const Change> Changes) const {
+  for (auto It = Changes.rbegin(); It != Changes.rend(); ++It) {
+    auto Cell = It->Cell;
+    if (!It->Value) {
+      auto Count = countBits(getPossibleValues(Brd, Cell));
+      Brd.Excluded[Cell] &= ~It->Excluded;
+      if (Heuristics.isBuckets)
+        moveCell(Brd, Cell, Count, Count + countBits(It->Excluded));
+      continue;
     }
-  }
-  return IsChange;
-}
 
-bool SudokuSolver::setTwinsColumn(Board &Brd) const {
-  auto IsChange = false;
-  for (auto Col = 0u; Col < NumSquares; ++Col) {
-    for (auto Row = 0; Row < NumSquares; ++Row) {
-      auto PossibleVals = Brd.Grid[Row][Col].PossibleValues;
-      if (PossibleVals.count() == 2) {
-        // Find twin
-        for (auto RowTw = Row + 1; RowTw < NumSquares; ++RowTw) {
-          if (PossibleVals == Brd.Grid[RowTw][Col].PossibleValues) {
-            // Remove the pair of possible values from all unset cells in col
-            for (auto RowRem = 0; RowRem < NumSquares; ++RowRem) {
-              if (RowRem != Row && RowRem != RowTw &&
-                  Brd.Grid[RowRem][Col].Value == 0 &&
-                  (Brd.Grid[RowRem][Col].PossibleValues & PossibleVals).any()) {
-                Brd.Grid[RowRem][Col].PossibleValues &= ~PossibleVals;
-                IsChange = true;
-              }
-            }
-          }
-        }
-      }
-    }
+    auto Bit = getBit<Mask>(It->Value - 1);
+    for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+      Brd.Used[Kind][CellUnits[Cell][Kind]] &= ~Bit;
+    Brd.Values[Cell] = 0;
+    if (!Heuristics.isBuckets)
+      continue;
+    // The peers get the value back, the later changes are already undone
+    Brd.Buckets.insert(Cell, countBits(getPossibleValues(Brd, Cell)));
+    forEachPeer(Cell, [&](unsigned Peer) {
+      auto PeerVals = getPossibleValues(Brd, Peer);
+      if (PeerVals & Bit)
+        moveCell(Brd, Peer, countBits(PeerVals) - 1, countBits(PeerVals));
+    });
   }
-  return IsChange;
 }
 
-bool SudokuSolver::solveHumanistic(Board &Brd) const {
-  auto IsChange = false;
-  do {
-    for (auto Row = 0; Row < NumSquares; ++Row) {
-      for (auto Col = 0; Col < NumSquares; ++Col)
-        if (!reducePossibleValues(Brd, Row, Col))
-          return false;
-    }
-    IsChange = eliminate(Brd);
-    if (!IsChange) {
-      IsChange = setLoneRangersRow(Brd);
-      if (!IsChange) {
-        IsChange = setLoneRangersColumn(Brd);
-        if (!IsChange) {
-          IsChange = setLoneRangersLittleSquare(Brd);
-          if (!IsChange) {
-            IsChange = setTwinsRow(Brd);
-            if (!IsChange)
-              IsChange = setTwinsColumn(Brd);
-          }
-        }
-      }
+template <unsigned MaxSquares>
+template <typename OnBranch, typename OnSolution>
+bool SizedSolver<MaxSquares>::searchInPlace(Board &Brd, SearchPath &Path,
+                                            OnBranch onBranch,
+                                            OnSolution onSolution) const {
+  auto &Changes = Path.Changes;
+  auto &Frames = Path.Frames;
+  Changes.clear();
+  Frames.clear();
+  // Branches the cell chosen on the board, false if the board is solved
+  auto pushFrame = [&]() {
+    auto [Row, Col] = getLeastUnsureCell(Brd);
+    if (Row == int(NumSquares))
+      return false;
+    auto &Frame = Frames.emplace_back();
+    Frame.Cell = Row * NumSquares + Col;
+    Frame.Mark = Changes.size();
+    Frame.CountLeft = orderValues(Brd, Frame.Cell, Frame.Values.data());
+    return true;
+  };
+  if (!pushFrame())
+    return onSolution(Brd);
+
+  while (!Frames.empty()) {
+    auto &Frame = Frames.back();
+    // Back to the board of the frame
+    undoChanges(Brd, std::span(Changes).subspan(Frame.Mark));
+    Changes.resize(Frame.Mark);
+    if (!Frame.CountLeft) {
+      Frames.pop_back();
+      continue;
     }
-  } while (IsChange);
-  if (!isCorrectInput(Brd))
-    return false;
+    if (!onBranch())
+      return false;
+    // The values may be shared by onBranch
+    if (!Frame.CountLeft)
+      continue;
 
+    auto Value = Frame.Values[--Frame.CountLeft];
+    if (tryValue(Brd, Frame.Cell, Value, &Changes) && !pushFrame() &&
+        !onSolution(Brd))
+      return false;
+  }
   return true;
 }
 
-void SudokuSolver::pushIdxPermutations(const std::pair<int, int> &Idx,
-                                       Board Brd,
-                                       std::vector<Board> *Stack) const {
-  auto [Row, Col] = Idx;
-  auto PossibleVals = Brd.Grid[Row][Col].PossibleValues;
-  Brd.CurrentIdx = {Row, Col};
-  auto Val = 1;
-  do {
-    if (PossibleVals[0]) {
-      Brd.Grid[Row][Col].Value = Val;
-      reducePossibleValues(Brd, Row, Col);
-      if (isCorrectInput(Brd))
-        Stack->push_back(Brd);
-    }
-    PossibleVals >>= 1;
-    ++Val;
-  } while (PossibleVals.count());
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::shareBranches(const Board &Brd,
+                                            SearchPath &Path,
+                                            std::vector<Board> &Shared) const {
+  auto Frame = std::find_if(Path.Frames.begin(), Path.Frames.end(),
+                            [](const SearchFrame &Frm) {
+                              return Frm.CountLeft > 0;
+                            });
+  if (Frame == Path.Frames.end())
+    return;
+  // The board of the frame is the current one with the deeper changes
+  // undone
+  Path.Spare = Brd;
+  undoChanges(Path.Spare, std::span(Path.Changes).subspan(Frame->Mark));
+  for (; Frame->CountLeft; --Frame->CountLeft) {
+    auto &Next = Shared.emplace_back(Path.Spare);
+    if (!tryValue(Next, Frame->Cell, Frame->Values[Frame->CountLeft - 1],
+                  nullptr))
+      Shared.pop_back();
+  }
 }
 
-bool SudokuSolver::solveBruteForce(Board &Brd) {
-#pragma omp parallel shared(SolutionFound, SolvedGrid)
+template <unsigned MaxSquares>
+size_t SizedSolver<MaxSquares>::solveBruteForce(const Board &Brd,
+                                                size_t Limit) {
+  std::vector<BranchDeque> Deques(omp_get_max_threads());
+  // Boards in the deques and boards being searched. Shared branches are
+  // counted before they are pushed, so zero means the search is over.
+  std::atomic<long> PendingBoards = 1;
+  // Threads without a board to search, they get the shallowest branches
+  // of the others.
+  std::atomic<unsigned> CountIdle = 0;
+  // Set when Limit solutions are found or the time is over, the threads
+  // leave then. Only the counters need it, the boards are written before
+  // the join.
+  std::atomic<bool> isStopped = false;
+  std::atomic<bool> isOutOfTime = false;
+  std::atomic<size_t> CountReported = 0;
+  double Deadline = SearchMaxSeconds ? omp_get_wtime() + SearchMaxSeconds : 0;
+  Deques[0].pushBack({Brd});
+
+  size_t CountSolutions = 0;
+#pragma omp parallel reduction(+ : CountSolutions)
   {
-    std::vector<Board> LocalStack;
+    // The board is searched in place, only the shared branches are copied
     Board CurrentBrd;
-
-    auto ThreadsNum = omp_get_num_threads();
-    for (auto NumGrid = omp_get_thread_num();
-         NumGrid < PermutationsStack.size() && !SolutionFound;
-         NumGrid += ThreadsNum) {
-      CurrentBrd = PermutationsStack[NumGrid];
-      LocalStack.push_back(CurrentBrd);
-
-      do {
-        while (!solveHumanistic(CurrentBrd) && !LocalStack.empty()) {
-          CurrentBrd = LocalStack.back();
-          LocalStack.pop_back();
-        }
-
-        // Search next cell
-        auto [Row, Col] = getLeastUnsureCell(CurrentBrd);
-        if (Row == NumSquares) {
-#pragma omp critical
-          {
-            SolutionFound = true;
-            SolvedGrid = CurrentBrd;
-          }
-          break;
-        }
-
-        pushIdxPermutations(std::pair(Row, Col), CurrentBrd, &LocalStack);
-
-        if (!LocalStack.empty()) {
-          CurrentBrd = LocalStack.back();
-          LocalStack.pop_back();
+    SearchPath Path;
+    std::vector<Board> Shared;
+    bool isIdle = false;
+    size_t CountBranches = 0;
+
+    unsigned Rank = omp_get_thread_num();
+    unsigned CountThreads = omp_get_num_threads();
+    auto onBranch = [&]() {
+      if (isStopped.load(std::memory_order_relaxed))
+        return false;
+      if (Deadline && ++CountBranches % SEARCH_CLOCK_PERIOD == 0 &&
+          omp_get_wtime() >= Deadline) {
+        isOutOfTime.store(true, std::memory_order_relaxed);
+        isStopped.store(true, std::memory_order_relaxed);
+        return false;
+      }
+      if (CountIdle.load(std::memory_order_relaxed) &&
+          Deques[Rank].isEmpty()) {
+        Shared.clear();
+        shareBranches(CurrentBrd, Path, Shared);
+        PendingBoards += Shared.size();
+        Deques[Rank].pushBack(Shared);
+      }
+      return true;
+    };
+    auto onSolution = [&](const Board &Solved) {
+      ++CountSolutions;
+      // The first thread to find a solution keeps it
+      if (!isSolutionFound.exchange(true))
+        SolvedGrid = Solved;
+      if (Limit && CountReported.fetch_add(1) + 1 >= Limit)
+        isStopped.store(true, std::memory_order_relaxed);
+      return !isStopped.load(std::memory_order_relaxed);
+    };
+
+    while (!isStopped.load(std::memory_order_relaxed) && PendingBoards > 0) {
+      if (!Deques[Rank].popBack(CurrentBrd) &&
+          !stealBranch(Deques, Rank, CountThreads, CurrentBrd)) {
+        if (!isIdle) {
+          isIdle = true;
+          ++CountIdle;
         }
-      } while (!LocalStack.empty() && !SolutionFound);
-    }
-  }
-  return true;
-}
-
-bool SudokuSolver::fillPermutationStack(Board &Brd) {
-  Board CurrentBrd;
-
-  std::vector<Board> Stack1Data, Stack2Data;
-  std::vector<Board> *Stack1, *Stack2;
-
-  Brd.CurrentIdx = {0, 0};
-  Stack1Data.push_back(Brd);
-
-  auto Step = 0;
-  do {
-    if (Step % 2) {
-      Stack1 = &Stack2Data;
-      Stack2 = &Stack1Data;
-    } else {
-      Stack1 = &Stack1Data;
-      Stack2 = &Stack2Data;
-    }
-    while (!Stack1->empty()) {
-      CurrentBrd = Stack1->back();
-      Stack1->pop_back();
-
-      // Search next cell
-      auto [Row, Col] = getLeastUnsureCell(CurrentBrd);
-      if (Row == NumSquares) {
-        SolutionFound = true;
-        SolvedGrid = CurrentBrd;
-        return true;
+        std::this_thread::yield();
+        continue;
       }
-      pushIdxPermutations(std::pair(Row, Col), CurrentBrd, Stack2);
-    }
-
-    // No solutions
-    if (Stack2->empty())
-      return false;
-    ++Step;
-  } while (Stack2->size() < STACK_SIZE);
-
-  PermutationsStack.resize(Stack2->size());
-  PermutationsStack = *Stack2;
-
-  return true;
-}
-
-std::pair<int, int> SudokuSolver::getLeastUnsureCell(const Board &Brd) const {
-  std::pair<int, int> Idx = {0, 0};
-  int Min = NumSquares + 1;
-  bool IsExist = false;
-  for (auto Row = 0; Row < NumSquares; ++Row) {
-    for (auto Col = 0; Col < NumSquares; ++Col) {
-      if (Brd.Grid[Row][Col].Value == 0 &&
-          Brd.Grid[Row][Col].PossibleValues.count() < Min) {
-        IsExist = true;
-        Idx = {Row, Col};
-        Min = Brd.Grid[Row][Col].PossibleValues.count();
+      if (isIdle) {
+        isIdle = false;
+        --CountIdle;
       }
+      searchInPlace(CurrentBrd, Path, onBranch, onSolution);
+      --PendingBoards;
     }
   }
-  if (!IsExist)
-    return {NumSquares, NumSquares};
-  assert(Min < NumSquares + 1);
-  return Idx;
+  isGivenUp = isOutOfTime;
+  // Threads may find solutions at once beyond the limit
+  return Limit ? std::min(CountSolutions, Limit) : CountSolutions;
 }
 
-bool SudokuSolver::solve() {
-  Board StartBoard(OriginalGrid);
-
-  // Setting all possible values
-  for (auto Row = 0; Row < NumSquares; ++Row) {
-    for (auto Col = 0; Col < NumSquares; ++Col)
-      setPossibleValues(StartBoard, Row, Col);
-  }
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::solve() {
+  return countSolutions(1) && isSolved(SolvedGrid);
+}
 
-  StartBoard.CurrentIdx = {0, 0};
+template <unsigned MaxSquares>
+size_t SizedSolver<MaxSquares>::countSolutions(size_t Limit) {
+  Board StartBoard(OriginalGrid);
+  isSolutionFound = false;
+  isGivenUp = false;
+  if (Heuristics.isBuckets)
+    initBuckets(StartBoard);
 
-  // First part -- humanistic algorithm
+  // First part -- humanistic algorithm. It only sets the values that
+  // are forced, so no solution is lost.
   if (!solveHumanistic(StartBoard))
-    return false;
+    return 0;
 
-  // If solved -> return true
+  // If solved -> the only solution
   if (isSolved(StartBoard)) {
-    SolvedGrid.Grid = StartBoard.Grid;
-    return true;
+    SolvedGrid = StartBoard;
+    isSolutionFound = true;
+    return 1;
   }
 
-  if (!fillPermutationStack(StartBoard))
-    return false;
-  if (SolutionFound)
-    return true;
   // If the humanistic algorithm returns a board with unfilled
   // cells left, then we pass it to the brute force algorithm
-  if (!solveBruteForce(StartBoard))
-    return false;
-
-  // If solved -> return true
-  if (SolutionFound && isSolved(SolvedGrid))
-    return true;
-  return false;
+  if (chooseEngine() == SolverEngine::DancingLinks)
+    return solveDancingLinks(StartBoard, Limit);
+  return solveBruteForce(StartBoard, Limit);
 }
 
-void SudokuSolver::setPossibleValues(Board &Brd, int Row, int Col) const {
-  auto Value = Brd.Grid[Row][Col].Value;
-  if (Value == 0) {
-    for (auto Val = 1u; Val <= NumSquares; ++Val)
-      Brd.Grid[Row][Col].PossibleValues.set(Val - 1);
-    return;
+template <unsigned MaxSquares>
+SolveStatus SizedSolver<MaxSquares>::solveAlone(size_t MaxBoards) {
+  Board CurrentBrd(OriginalGrid);
+  isSolutionFound = false;
+  if (Heuristics.isBuckets)
+    initBuckets(CurrentBrd);
+  if (!solveHumanistic(CurrentBrd))
+    return SolveStatus::Unsolvable;
+
+  if (chooseEngine() == SolverEngine::DancingLinks) {
+    buildExactCover(CurrentBrd);
+    Matrix.setStepLimit(MaxBoards);
+    std::atomic<bool> isStopped = false;
+    Matrix.search(isStopped, [&](const std::vector<int32_t> &Rows) {
+      SolvedGrid = CurrentBrd;
+      setCover(SolvedGrid, Rows);
+      isSolutionFound = true;
+      return false;
+    });
+    if (isSolutionFound)
+      return isSolved(SolvedGrid) ? SolveStatus::Solved
+                                  : SolveStatus::Unsolvable;
+    return Matrix.isOutOfSteps() ? SolveStatus::GaveUp
+                                 : SolveStatus::Unsolvable;
   }
-  Brd.Grid[Row][Col].PossibleValues.set(Value - 1);
+
+  size_t CountBoards = 0;
+  searchInPlace(
+      CurrentBrd, AlonePath, [&]() { return ++CountBoards <= MaxBoards; },
+      [&](const Board &Solved) {
+        SolvedGrid = Solved;
+        isSolutionFound = true;
+        return false;
+      });
+  if (isSolutionFound)
+    return isSolved(SolvedGrid) ? SolveStatus::Solved
+                                : SolveStatus::Unsolvable;
+  if (CountBoards > MaxBoards)
+    return SolveStatus::GaveUp;
+  return SolveStatus::Unsolvable;
 }
 
-bool SudokuSolver::reducePossibleValues(Board &Brd, int Row, int Col) const {
-  assert(Brd.Grid.size() == NumSquares);
-  if (Brd.Grid[Row][Col].Value > 0) {
-    Brd.Grid[Row][Col].PossibleValues.reset();
-    Brd.Grid[Row][Col].PossibleValues.set(Brd.Grid[Row][Col].Value - 1);
-    assert(Brd.Grid[Row][Col].PossibleValues.count() == 1);
-    return true;
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::getSolution(std::vector<int> &Array) const {
+  assert(isSolutionFound);
+  Array.assign(SolvedGrid.Values.begin(),
+               SolvedGrid.Values.begin() + NumSquares * NumSquares);
+}
+
+// Least of the sizes SOLVER_SIZES not less than NumSquares, 0 if none.
+static unsigned getSolverSize(unsigned NumSquares) {
+#define CHECK_SIZE(Size)                                                       \
+  if (NumSquares <= Size)                                                      \
+    return Size;
+  SOLVER_SIZES(CHECK_SIZE)
+#undef CHECK_SIZE
+  return 0;
+}
+
+std::unique_ptr<SudokuSolver> makeSolver(unsigned NumSquares) {
+  switch (getSolverSize(NumSquares)) {
+#define MAKE_SOLVER(Size)                                                      \
+  case Size:                                                                   \
+    return std::make_unique<SizedSolver<Size>>();
+    SOLVER_SIZES(MAKE_SOLVER)
+#undef MAKE_SOLVER
   }
-  auto SqRowSt = (Row / LittleSqDim) * LittleSqDim,
-       SqColSt = (Col / LittleSqDim) * LittleSqDim;
-  for (auto Idx = 0; Idx < NumSquares; Idx++) {
-    auto SqRow = Idx / LittleSqDim;
-    auto SqCol = Idx % LittleSqDim;
-    auto Value = Brd.Grid[Row][Idx].Value;
-    // Check row
-    if (Value > 0)
-      Brd.Grid[Row][Col].PossibleValues.reset(Value - 1);
-
-    Value = Brd.Grid[Idx][Col].Value;
-    // Check column
-    if (Value > 0)
-      Brd.Grid[Row][Col].PossibleValues.reset(Value - 1);
-
-    Value = Brd.Grid[SqRowSt + SqRow][SqColSt + SqCol].Value;
-    // Check little square
-    if (Value > 0)
-      Brd.Grid[Row][Col].PossibleValues.reset(Value - 1);
+  failWithError("Размер судоку больше " + std::to_string(MAX_NUM_SQUARES));
+  return nullptr;
+}
+
+void loadSolver(std::unique_ptr<SudokuSolver> &Solver,
+                const std::vector<int> &Array, const SolverOptions &Options) {
+  auto Squares = getSudokuSize(Array);
+  if (!Solver || Solver->getMaxNumSquares() != getSolverSize(Squares)) {
+    Solver = makeSolver(Squares);
+    Solver->setOptions(Options);
   }
-  if (Brd.Grid[Row][Col].PossibleValues.none())
-    return /* No possible values */ false;
-  return true;
+  Solver->load(Array);
 }
 
+#define INSTANTIATE_SOLVER(Size) template class SizedSolver<Size>;
+SOLVER_SIZES(INSTANTIATE_SOLVER)
+#undef INSTANTIATE_SOLVER
+
 } // namespace SudokuGame
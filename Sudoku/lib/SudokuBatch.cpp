@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "Sudoku.h"
+#include "SudokuBatch.h"
+#include "json.hpp"
+
+namespace SudokuGame {
+
+namespace {
+
+enum class PuzzleStatus { Solved, Unsolvable, Invalid, Hard, GaveUp };
+
+// Value of a character of the text format, -1 for a wrong one.
+int getCharValue(char Char) {
+  if (Char == '.' || Char == '0')
+    return 0;
+  if (Char >= '1' && Char <= '9')
+    return Char - '0';
+  if (Char >= 'A' && Char <= 'Z')
+    return Char - 'A' + 10;
+  if (Char >= 'a' && Char <= 'z')
+    return Char - 'a' + 10;
+  return -1;
+}
+
+char getValueChar(int Value) {
+  if (Value <= 9)
+    return '0' + Value;
+  return 'A' + Value - 10;
+}
+
+// Reads the puzzles by chunks: the text line by line, json at once.
+// Wrong puzzles are read as they are and rejected by the solver.
+class PuzzleReader {
+  std::istream &In;
+  bool isJson = false;
+  nlohmann::json JsonData;
+  size_t NextJson = 0;
+  std::string Line;
+
+public:
+  PuzzleReader(std::istream &In) : In(In) {
+    In >> std::ws;
+    isJson = In.peek() == '[' || In.peek() == '{';
+    if (!isJson)
+      return;
+    In >> JsonData;
+    if (!JsonData.is_array())
+      JsonData = nlohmann::json::array({JsonData});
+  }
+
+  bool isJsonFormat() const { return isJson; }
+
+  // Returns the number of the puzzles read, 0 at the end.
+  size_t read(std::vector<std::vector<int>> &Puzzles) {
+    size_t Count = 0;
+    while (Count < Puzzles.size() && readPuzzle(Puzzles[Count]))
+      ++Count;
+    return Count;
+  }
+
+private:
+  bool readPuzzle(std::vector<int> &Puzzle) {
+    Puzzle.clear();
+    if (isJson) {
+      if (NextJson == JsonData.size())
+        return false;
+      auto &Elem = JsonData[NextJson++];
+      try {
+        if (Elem.is_object() && Elem.contains("sudoku"))
+          Elem["sudoku"].get_to(Puzzle);
+        else if (Elem.is_array())
+          Elem.get_to(Puzzle);
+      } catch (const nlohmann::json::exception &) {
+        Puzzle.clear();
+      }
+      return true;
+    }
+
+    while (std::getline(In, Line)) {
+      for (auto Char : Line)
+        if (!std::isspace(static_cast<unsigned char>(Char)))
+          Puzzle.push_back(getCharValue(Char));
+      // Empty lines and comments are skipped
+      if (!Puzzle.empty() && Line.find('#') != 0) {
+        // The values of larger puzzles can't be written back
+        if (Puzzle.size() >
+            BATCH_TEXT_MAX_NUM_SQUARES * BATCH_TEXT_MAX_NUM_SQUARES)
+          Puzzle.clear();
+        return true;
+      }
+      Puzzle.clear();
+    }
+    return false;
+  }
+};
+
+class SolutionWriter {
+  std::ostream &Out;
+  bool isJson;
+  bool isFirst = true;
+  std::string Line;
+
+public:
+  SolutionWriter(std::ostream &Out, bool isJson) : Out(Out), isJson(isJson) {
+    if (isJson)
+      Out << "[";
+  }
+
+  // nullptr for a puzzle without a solution.
+  void write(const std::vector<int> *Solution) {
+    if (isJson) {
+      Out << (isFirst ? "\n  " : ",\n  ");
+      if (Solution)
+        Out << nlohmann::json(*Solution).dump();
+      else
+        Out << "null";
+    } else if (Solution) {
+      Line.clear();
+      for (auto Value : *Solution)
+        Line.push_back(getValueChar(Value));
+      Out << Line << "\n";
+    } else
+      Out << "-\n";
+    isFirst = false;
+  }
+
+  void finish() {
+    if (isJson)
+      Out << (isFirst ? "]\n" : "\n]\n");
+    Out.flush();
+  }
+};
+
+// Solves a puzzle in the calling thread, it is left for all the threads
+// if it turns out to be hard.
+PuzzleStatus solvePuzzle(std::unique_ptr<SudokuSolver> &Solver,
+                         const SolverOptions &Options,
+                         const std::vector<int> &Puzzle,
+                         std::vector<int> &Solution) {
+  try {
+    loadSolver(Solver, Puzzle, Options);
+    switch (Solver->solveAlone(BATCH_MAX_BOARDS)) {
+    case SolveStatus::Solved:
+      Solver->getSolution(Solution);
+      return PuzzleStatus::Solved;
+    case SolveStatus::Unsolvable:
+      return PuzzleStatus::Unsolvable;
+    case SolveStatus::GaveUp:
+      return PuzzleStatus::Hard;
+    }
+  } catch (const std::exception &) {
+  }
+  return PuzzleStatus::Invalid;
+}
+
+} // namespace
+
+void BatchReport::print(std::ostream &Out) {
+  Out << "Puzzles: " << CountPuzzles << ", solved: " << CountSolved
+      << ", without solution: " << CountUnsolvable
+      << ", invalid: " << CountInvalid
+      << ", solved by all the threads: " << CountHard
+      << ", given up: " << CountGaveUp << "\n";
+  Out << "Time: " << Seconds << " sec, " << CountPuzzles / Seconds
+      << " puzzles/sec\n";
+  if (Latencies.empty())
+    return;
+
+  std::sort(Latencies.begin(), Latencies.end());
+  auto getPercentile = [&](double Percent) {
+    auto Rank = std::ceil(Percent / 100 * Latencies.size());
+    return Latencies[std::max(Rank, 1.) - 1];
+  };
+  Out << "Latency, ms: p50 " << getPercentile(50) << ", p90 "
+      << getPercentile(90) << ", p99 " << getPercentile(99) << ", p99.9 "
+      << getPercentile(99.9) << ", max " << Latencies.back() << "\n";
+}
+
+BatchReport solveBatch(std::istream &In, std::ostream &Out,
+                       const SolverOptions &Options) {
+  BatchReport Report;
+  PuzzleReader Reader{In};
+  SolutionWriter Writer{Out, Reader.isJsonFormat()};
+
+  // Buffers of a chunk and the solvers of the threads are reused, so the
+  // boards are not allocated for every puzzle. A solver is replaced only
+  // by a puzzle of a size it is not compiled for.
+  std::vector<std::vector<int>> Puzzles(BATCH_CHUNK_SIZE);
+  std::vector<std::vector<int>> Solutions(BATCH_CHUNK_SIZE);
+  std::vector<PuzzleStatus> Statuses(BATCH_CHUNK_SIZE);
+  std::vector<double> Latencies(BATCH_CHUNK_SIZE);
+  std::vector<std::unique_ptr<SudokuSolver>> Solvers(omp_get_max_threads());
+
+  auto StartTime = omp_get_wtime();
+  while (auto Count = Reader.read(Puzzles)) {
+    // Many easy puzzles in parallel, a puzzle per thread
+#pragma omp parallel for schedule(dynamic, 16)
+    for (size_t Idx = 0; Idx < Count; ++Idx) {
+      auto Start = omp_get_wtime();
+      Statuses[Idx] = solvePuzzle(Solvers[omp_get_thread_num()], Options,
+                                  Puzzles[Idx], Solutions[Idx]);
+      Latencies[Idx] = (omp_get_wtime() - Start) * 1000;
+    }
+
+    // Hard puzzles one by one, each by all the threads
+    for (size_t Idx = 0; Idx < Count; ++Idx) {
+      if (Statuses[Idx] != PuzzleStatus::Hard)
+        continue;
+      ++Report.CountHard;
+      auto Start = omp_get_wtime();
+      auto &Solver = Solvers.front();
+      loadSolver(Solver, Puzzles[Idx], Options);
+      Statuses[Idx] = PuzzleStatus::Unsolvable;
+      if (Solver->solve()) {
+        Solver->getSolution(Solutions[Idx]);
+        Statuses[Idx] = PuzzleStatus::Solved;
+      } else if (Solver->hasGivenUp())
+        Statuses[Idx] = PuzzleStatus::GaveUp;
+      Latencies[Idx] += (omp_get_wtime() - Start) * 1000;
+    }
+
+    for (size_t Idx = 0; Idx < Count; ++Idx) {
+      auto Status = Statuses[Idx];
+      Writer.write(Status == PuzzleStatus::Solved ? &Solutions[Idx]
+                                                  : nullptr);
+      Report.CountSolved += Status == PuzzleStatus::Solved;
+      Report.CountUnsolvable += Status == PuzzleStatus::Unsolvable;
+      Report.CountInvalid += Status == PuzzleStatus::Invalid;
+      Report.CountGaveUp += Status == PuzzleStatus::GaveUp;
+    }
+    Report.CountPuzzles += Count;
+    Report.Latencies.insert(Report.Latencies.end(), Latencies.begin(),
+                            Latencies.begin() + Count);
+  }
+  Writer.finish();
+  Report.Seconds = omp_get_wtime() - StartTime;
+  return Report;
+}
+
+} // namespace SudokuGame
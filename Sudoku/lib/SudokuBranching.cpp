@@ -0,0 +1,135 @@
+#include <algorithm>
+
+#include "Sudoku.h"
+
+namespace SudokuGame {
+
+BranchHeuristics getBranchHeuristics(const std::string &Names) {
+  BranchHeuristics Heuristics;
+  if (Names == "none")
+    return Heuristics;
+  if (Names == "all")
+    return {true, true, true};
+
+  for (size_t Start = 0; Start <= Names.size();) {
+    auto End = std::min(Names.find(',', Start), Names.size());
+    auto Name = Names.substr(Start, End - Start);
+    if (Name == "buckets")
+      Heuristics.isBuckets = true;
+    else if (Name == "degree")
+      Heuristics.isDegree = true;
+    else if (Name == "lcv")
+      Heuristics.isLeastConstraining = true;
+    else
+      failWithError("Unknown branching heuristic \"" + Name + "\"");
+    Start = End + 1;
+  }
+  return Heuristics;
+}
+
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::initBuckets(Board &Brd) const {
+  auto &Buckets = Brd.Buckets;
+  Buckets.Heads.fill(NoCell);
+  Buckets.NonEmpty = 0;
+  // Cells are inserted at the heads, so the first cell leads its bucket
+  // as with the scan
+  for (auto Cell = NumSquares * NumSquares; Cell-- > 0;)
+    if (!Brd.Values[Cell])
+      Buckets.insert(Cell, countBits(getPossibleValues(Brd, Cell)));
+}
+
+template <unsigned MaxSquares>
+std::pair<int, int>
+SizedSolver<MaxSquares>::getLeastUnsureCell(const Board &Brd) const {
+  unsigned Idx = 0;
+  int Min = NumSquares + 1;
+  unsigned MaxDegree = 0;
+  bool IsExist = false;
+
+  if (Heuristics.isBuckets) {
+    auto &Buckets = Brd.Buckets;
+    // A cell without values is a dead end, it is taken first
+    if (Buckets.Heads[0] != NoCell)
+      Min = 0;
+    else if (Buckets.NonEmpty)
+      Min = getLowestBit(Buckets.NonEmpty) + 1;
+    else
+      return {NumSquares, NumSquares};
+    Idx = Buckets.Heads[Min];
+    if (Heuristics.isDegree && Min > 1) {
+      MaxDegree = getDegree(Brd, Idx);
+      for (auto Cell = Buckets.Next[Idx]; Cell != NoCell;
+           Cell = Buckets.Next[Cell])
+        if (auto Degree = getDegree(Brd, Cell); Degree > MaxDegree) {
+          Idx = Cell;
+          MaxDegree = Degree;
+        }
+    }
+    return {Idx / NumSquares, Idx % NumSquares};
+  }
+
+  for (auto Cell = 0u; Cell < NumSquares * NumSquares; ++Cell) {
+    if (Brd.Values[Cell])
+      continue;
+    int Count = countBits(getPossibleValues(Brd, Cell));
+    if (Count > Min)
+      continue;
+    if (Count == Min) {
+      if (!Heuristics.isDegree)
+        continue;
+      auto Degree = getDegree(Brd, Cell);
+      if (Degree <= MaxDegree)
+        continue;
+      MaxDegree = Degree;
+    } else {
+      Min = Count;
+      if (Heuristics.isDegree)
+        MaxDegree = getDegree(Brd, Cell);
+    }
+    IsExist = true;
+    Idx = Cell;
+    // Nobody is more sure
+    if (Min <= 1)
+      break;
+  }
+  if (!IsExist)
+    return {NumSquares, NumSquares};
+  assert(Min <= int(NumSquares));
+  return {Idx / NumSquares, Idx % NumSquares};
+}
+
+template <unsigned MaxSquares>
+unsigned SizedSolver<MaxSquares>::orderValues(const Board &Brd, unsigned Cell,
+                                              uint8_t *Values) const {
+  Mask PossibleVals = getPossibleValues(Brd, Cell);
+  auto Count = 0u;
+  for (Mask Vals = PossibleVals; Vals; clearLowestBit(Vals))
+    Values[Count++] = getLowestBit(Vals) + 1;
+  if (!Heuristics.isLeastConstraining)
+    return Count;
+
+  // Peers that lose every value if it is set
+  std::array<unsigned, MaxSquares> Constraints{};
+  forEachPeer(Cell, [&](unsigned Peer) {
+    for (Mask Vals = getPossibleValues(Brd, Peer) & PossibleVals; Vals;
+         clearLowestBit(Vals))
+      ++Constraints[getLowestBit(Vals)];
+  });
+  // The least constraining value goes to the back
+  std::stable_sort(Values, Values + Count, [&](unsigned Lhs, unsigned Rhs) {
+    return Constraints[Lhs - 1] > Constraints[Rhs - 1];
+  });
+  return Count;
+}
+
+#define INSTANTIATE_BRANCHING(Size)                                            \
+  template void SizedSolver<Size>::initBuckets(Board &) const;                 \
+  template std::pair<int, int> SizedSolver<Size>::getLeastUnsureCell(          \
+      const Board &) const;                                                    \
+  template unsigned SizedSolver<Size>::orderValues(const Board &, unsigned,    \
+                                                   uint8_t *) const;
+SOLVER_SIZES(INSTANTIATE_BRANCHING)
+#undef INSTANTIATE_BRANCHING
+
+} // namespace SudokuGame
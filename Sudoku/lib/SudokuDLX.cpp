@@ -0,0 +1,228 @@
+#include "SudokuDLX.h"
+#include "Sudoku.h"
+
+namespace SudokuGame {
+
+void DancingLinks::reset(unsigned CountColumns, size_t CountRowNodes) {
+  Nodes.clear();
+  Nodes.reserve(CountColumns + 1 + CountRowNodes);
+  Sizes.assign(CountColumns + 1, 0);
+  Selected.clear();
+  MaxSteps = 0;
+  CountSteps = 0;
+  Deadline = 0;
+  isLate = false;
+
+  // The root and the headers in a circular list, every header is an
+  // empty column of its own
+  for (int32_t Idx = 0; Idx <= int32_t(CountColumns); ++Idx)
+    Nodes.push_back({Idx - 1, Idx + 1, Idx, Idx, Idx, -1});
+  Nodes.front().Left = CountColumns;
+  Nodes.back().Right = 0;
+}
+
+void DancingLinks::addRow(int32_t Row, std::span<const int32_t> Columns) {
+  int32_t First = Nodes.size();
+  for (auto Column : Columns) {
+    int32_t Idx = Nodes.size();
+    auto Last = Nodes[Column].Up;
+    Nodes.push_back({Idx - 1, Idx + 1, Last, Column, Column, Row});
+    Nodes[Last].Down = Idx;
+    Nodes[Column].Up = Idx;
+    ++Sizes[Column];
+  }
+  Nodes[First].Left = Nodes.size() - 1;
+  Nodes.back().Right = First;
+}
+
+int32_t DancingLinks::chooseColumn() const {
+  int32_t Best = 0;
+  for (auto Column = Nodes[0].Right; Column; Column = Nodes[Column].Right)
+    if (!Best || Sizes[Column] < Sizes[Best]) {
+      Best = Column;
+      if (Sizes[Best] <= 1)
+        break;
+    }
+  return Best;
+}
+
+std::vector<int32_t> DancingLinks::getColumnNodes(int32_t Column) const {
+  std::vector<int32_t> RowNodes;
+  for (auto Idx = Nodes[Column].Down; Idx != Column; Idx = Nodes[Idx].Down)
+    RowNodes.push_back(Idx);
+  return RowNodes;
+}
+
+void DancingLinks::cover(int32_t Column) {
+  auto &Header = Nodes[Column];
+  Nodes[Header.Right].Left = Header.Left;
+  Nodes[Header.Left].Right = Header.Right;
+  for (auto Row = Header.Down; Row != Column; Row = Nodes[Row].Down)
+    for (auto Idx = Nodes[Row].Right; Idx != Row; Idx = Nodes[Idx].Right) {
+      auto &Cur = Nodes[Idx];
+      Nodes[Cur.Down].Up = Cur.Up;
+      Nodes[Cur.Up].Down = Cur.Down;
+      --Sizes[Cur.Column];
+    }
+}
+
+void DancingLinks::uncover(int32_t Column) {
+  auto &Header = Nodes[Column];
+  for (auto Row = Header.Up; Row != Column; Row = Nodes[Row].Up)
+    for (auto Idx = Nodes[Row].Left; Idx != Row; Idx = Nodes[Idx].Left) {
+      auto &Cur = Nodes[Idx];
+      Nodes[Cur.Down].Up = Idx;
+      Nodes[Cur.Up].Down = Idx;
+      ++Sizes[Cur.Column];
+    }
+  Nodes[Header.Right].Left = Column;
+  Nodes[Header.Left].Right = Column;
+}
+
+void DancingLinks::selectRow(int32_t RowNode) {
+  Selected.push_back(Nodes[RowNode].Row);
+  ++CountSteps;
+  for (auto Idx = Nodes[RowNode].Right; Idx != RowNode; Idx = Nodes[Idx].Right)
+    cover(Nodes[Idx].Column);
+}
+
+void DancingLinks::unselectRow(int32_t RowNode) {
+  for (auto Idx = Nodes[RowNode].Left; Idx != RowNode; Idx = Nodes[Idx].Left)
+    uncover(Nodes[Idx].Column);
+  Selected.pop_back();
+}
+
+bool DancingLinks::search(const std::atomic<bool> &isStopped,
+                          const CoverHandler &onCover) {
+  auto Column = chooseColumn();
+  if (!Column)
+    return onCover(Selected);
+  if (!Sizes[Column])
+    return true;
+  if (Deadline && CountSteps % SEARCH_CLOCK_PERIOD == 0 &&
+      omp_get_wtime() >= Deadline)
+    isLate = true;
+  if (isStopped.load(std::memory_order_relaxed) || isOutOfSteps() || isLate)
+    return false;
+
+  cover(Column);
+  auto isGoing = true;
+  for (auto Row = Nodes[Column].Down; isGoing && Row != Column;
+       Row = Nodes[Row].Down) {
+    selectRow(Row);
+    isGoing = search(isStopped, onCover);
+    unselectRow(Row);
+  }
+  uncover(Column);
+  return isGoing;
+}
+
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::buildExactCover(const Board &Brd) {
+  auto NumCells = NumSquares * NumSquares;
+  // Column of every constraint of the sudoku, 0 for the ones met: a value
+  // in every cell, then every value in every unit
+  std::vector<int32_t> ColumnOf((COUNT_UNIT_KINDS + 1) * NumCells, 0);
+  auto getUnitColumn = [&](unsigned Kind, unsigned Unit, unsigned Val) {
+    return &ColumnOf[((Kind + 1) * NumSquares + Unit) * NumSquares + Val];
+  };
+  int32_t CountColumns = 0;
+  size_t CountRows = 0;
+  for (auto Cell = 0u; Cell < NumCells; ++Cell)
+    if (!Brd.Values[Cell]) {
+      ColumnOf[Cell] = ++CountColumns;
+      CountRows += countBits(getPossibleValues(Brd, Cell));
+    }
+  for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+    for (auto Unit = 0u; Unit < NumSquares; ++Unit)
+      for (auto Val = 0u; Val < NumSquares; ++Val)
+        if (!hasBit(Brd.Used[Kind][Unit], Val))
+          *getUnitColumn(Kind, Unit, Val) = ++CountColumns;
+
+  Matrix.reset(CountColumns, (COUNT_UNIT_KINDS + 1) * CountRows);
+  std::array<int32_t, COUNT_UNIT_KINDS + 1> Columns;
+  for (auto Cell = 0u; Cell < NumCells; ++Cell)
+    for (auto Vals = getPossibleValues(Brd, Cell); Vals;
+         clearLowestBit(Vals)) {
+      auto Val = getLowestBit(Vals);
+      Columns[0] = ColumnOf[Cell];
+      for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+        Columns[Kind + 1] = *getUnitColumn(Kind, CellUnits[Cell][Kind], Val);
+      Matrix.addRow(Cell * NumSquares + Val, Columns);
+    }
+}
+
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::setCover(Board &Brd,
+                                       const std::vector<int32_t> &Rows) const {
+  for (auto Row : Rows)
+    setValue(Brd, Row / NumSquares, Row % NumSquares + 1);
+}
+
+template <unsigned MaxSquares>
+size_t SizedSolver<MaxSquares>::solveDancingLinks(const Board &Brd,
+                                                  size_t Limit) {
+  buildExactCover(Brd);
+  auto First = Matrix.chooseColumn();
+  auto FirstRows = Matrix.getColumnNodes(First);
+  // The copies of the threads take the deadline with the matrix
+  if (SearchMaxSeconds)
+    Matrix.setDeadline(omp_get_wtime() + SearchMaxSeconds);
+  // Set when Limit solutions are found or the time is over, the threads
+  // leave then
+  std::atomic<bool> isStopped = false;
+  std::atomic<bool> isOutOfTime = false;
+  std::atomic<size_t> CountReported = 0;
+
+  size_t CountSolutions = 0;
+#pragma omp parallel reduction(+ : CountSolutions)
+  {
+    // The search relinks the nodes, so the other threads take copies
+    // before the first one starts in the matrix itself
+    DancingLinks Copy;
+    if (omp_get_thread_num())
+      Copy = Matrix;
+    auto &Local = omp_get_thread_num() ? Copy : Matrix;
+#pragma omp barrier
+
+    auto onCover = [&](const std::vector<int32_t> &Rows) {
+      ++CountSolutions;
+      // The first thread to find a solution keeps it
+      if (!isSolutionFound.exchange(true)) {
+        SolvedGrid = Brd;
+        setCover(SolvedGrid, Rows);
+      }
+      if (Limit && CountReported.fetch_add(1) + 1 >= Limit)
+        isStopped.store(true, std::memory_order_relaxed);
+      return !isStopped.load(std::memory_order_relaxed);
+    };
+    Local.cover(First);
+#pragma omp for schedule(dynamic, 1)
+    for (size_t Idx = 0; Idx < FirstRows.size(); ++Idx) {
+      if (isStopped.load(std::memory_order_relaxed))
+        continue;
+      Local.selectRow(FirstRows[Idx]);
+      Local.search(isStopped, onCover);
+      Local.unselectRow(FirstRows[Idx]);
+      if (Local.isOutOfTime()) {
+        isOutOfTime.store(true, std::memory_order_relaxed);
+        isStopped.store(true, std::memory_order_relaxed);
+      }
+    }
+    Local.uncover(First);
+  }
+  isGivenUp = isOutOfTime;
+  // Threads may find solutions at once beyond the limit
+  return Limit ? std::min(CountSolutions, Limit) : CountSolutions;
+}
+
+#define INSTANTIATE_DANCING_LINKS(Size)                                        \
+  template void SizedSolver<Size>::buildExactCover(const Board &);             \
+  template void SizedSolver<Size>::setCover(Board &,                           \
+                                            const std::vector<int32_t> &)      \
+      const;                                                                   \
+  template size_t SizedSolver<Size>::solveDancingLinks(const Board &, size_t);
+SOLVER_SIZES(INSTANTIATE_DANCING_LINKS)
+#undef INSTANTIATE_DANCING_LINKS
+
+} // namespace SudokuGame
@@ -0,0 +1,284 @@
+#include <algorithm>
+
+#include "Sudoku.h"
+
+namespace SudokuGame {
+
+namespace {
+
+const Strategy AllStrategies[] = {
+    {"pointing", StrategyKind::Pointing, 1},
+    {"boxline", StrategyKind::BoxLine, 1},
+    {"naked2", StrategyKind::NakedSubset, 2},
+    {"hidden2", StrategyKind::HiddenSubset, 2},
+    {"naked3", StrategyKind::NakedSubset, 3},
+    {"hidden3", StrategyKind::HiddenSubset, 3},
+    {"naked4", StrategyKind::NakedSubset, 4},
+    {"hidden4", StrategyKind::HiddenSubset, 4},
+    {"xwing", StrategyKind::Fish, 2},
+    {"swordfish", StrategyKind::Fish, 3}};
+
+double getCombinations(double Count, unsigned Size) {
+  double Result = 1;
+  for (auto Idx = 0u; Idx < Size; ++Idx)
+    Result = Result * (Count - Idx) / (Idx + 1);
+  return Result;
+}
+
+// Calls onSubset(Indices, Union) for every Size sets of Sets whose union
+// has Size elements, the sets themselves must not be empty. Returns true
+// if some call does.
+template <typename Mask>
+bool forEachSubset(const Mask *Sets, unsigned Count, unsigned Size,
+                   auto onSubset) {
+  auto IsChange = false;
+  auto search = [&](auto &search, unsigned Start, unsigned Depth,
+                    Mask Indices, Mask Union) -> void {
+    if (Depth == Size) {
+      IsChange |= onSubset(Indices, Union);
+      return;
+    }
+    for (auto Idx = Start; Idx + Size - Depth <= Count; ++Idx) {
+      Mask NewUnion = Union | Sets[Idx];
+      if (Sets[Idx] && countBits(NewUnion) <= int(Size))
+        search(search, Idx + 1, Depth + 1, Indices | getBit<Mask>(Idx),
+               NewUnion);
+    }
+  };
+  search(search, 0, 0, 0, 0);
+  return IsChange;
+}
+
+} // namespace
+
+double getStrategyCost(const Strategy &Strat, unsigned NumSquares) {
+  // Going over the possible values of all the cells of a kind of units
+  double N = NumSquares;
+  double ValuesOfCells = N * N * N;
+  switch (Strat.Kind) {
+  case StrategyKind::Pointing:
+    return ValuesOfCells;
+  case StrategyKind::BoxLine:
+    return 2 * ValuesOfCells;
+  case StrategyKind::NakedSubset:
+    return COUNT_UNIT_KINDS * N * (N + getCombinations(N, Strat.Size));
+  case StrategyKind::HiddenSubset:
+    return COUNT_UNIT_KINDS *
+           (ValuesOfCells + N * getCombinations(N, Strat.Size));
+  case StrategyKind::Fish:
+    return ValuesOfCells + 2 * N * getCombinations(N, Strat.Size);
+  }
+  return 0;
+}
+
+std::vector<Strategy> getStrategies(const std::string &Names) {
+  std::vector<Strategy> Strategies;
+  if (Names == "none")
+    return Strategies;
+  if (Names == "all")
+    return {std::begin(AllStrategies), std::end(AllStrategies)};
+
+  for (size_t Start = 0; Start <= Names.size();) {
+    auto End = std::min(Names.find(',', Start), Names.size());
+    auto Name = Names.substr(Start, End - Start);
+    auto Found = std::find_if(
+        std::begin(AllStrategies), std::end(AllStrategies),
+        [&](const Strategy &Strat) { return Name == Strat.Name; });
+    if (Found == std::end(AllStrategies))
+      failWithError("Unknown strategy \"" + Name + "\"");
+    Strategies.push_back(*Found);
+    Start = End + 1;
+  }
+  return Strategies;
+}
+
+template <unsigned MaxSquares>
+void SizedSolver<MaxSquares>::setStrategies(
+    const std::vector<Strategy> &NewStrategies) {
+  Strategies = NewStrategies;
+  for (auto &Strat : Strategies)
+    Strat.Cost = getStrategyCost(Strat, NumSquares);
+  std::stable_sort(Strategies.begin(), Strategies.end(),
+                   [](const Strategy &Lhs, const Strategy &Rhs) {
+                     return Lhs.Cost < Rhs.Cost;
+                   });
+}
+
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::excludeValues(Board &Brd, unsigned Cell,
+                                            Mask Values,
+                                            UnitQueue &Queue) const {
+  auto PossibleVals = getPossibleValues(Brd, Cell);
+  Mask Excluded = PossibleVals & Values;
+  if (!Excluded)
+    return false;
+  if (Heuristics.isBuckets)
+    moveCell(Brd, Cell, countBits(PossibleVals),
+             countBits(PossibleVals) - countBits(Excluded));
+  Brd.Excluded[Cell] |= Excluded;
+  if (Queue.Changes)
+    Queue.Changes->push_back({uint16_t(Cell), 0, Excluded});
+  for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+    Queue.push(Kind, CellUnits[Cell][Kind]);
+  return true;
+}
+
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::deduce(Board &Brd, UnitQueue &Queue,
+                                     double MaxCost) const {
+  if (!propagate(Brd, Queue))
+    return false;
+  // A strategy is tried only when the cheaper ones find nothing, and
+  // after any success the cheapest ones are tried again.
+  for (auto Next = Strategies.begin();
+       Next != Strategies.end() && Next->Cost <= MaxCost;) {
+    if (!applyStrategy(Brd, *Next, Queue)) {
+      ++Next;
+      continue;
+    }
+    if (!propagate(Brd, Queue))
+      return false;
+    Next = Strategies.begin();
+  }
+  return true;
+}
+
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::applyStrategy(Board &Brd, const Strategy &Strat,
+                                            UnitQueue &Queue) const {
+  switch (Strat.Kind) {
+  case StrategyKind::Pointing:
+    return excludeLocked(Brd, LittleSquareUnit, RowUnit, Queue) |
+           excludeLocked(Brd, LittleSquareUnit, ColumnUnit, Queue);
+  case StrategyKind::BoxLine:
+    return excludeLocked(Brd, RowUnit, LittleSquareUnit, Queue) |
+           excludeLocked(Brd, ColumnUnit, LittleSquareUnit, Queue);
+  case StrategyKind::NakedSubset:
+    return excludeNakedSubsets(Brd, Strat.Size, Queue);
+  case StrategyKind::HiddenSubset:
+    return excludeHiddenSubsets(Brd, Strat.Size, Queue);
+  case StrategyKind::Fish:
+    return excludeFish(Brd, RowUnit, ColumnUnit, Strat.Size, Queue) |
+           excludeFish(Brd, ColumnUnit, RowUnit, Strat.Size, Queue);
+  }
+  return false;
+}
+
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::excludeLocked(Board &Brd, unsigned Kind,
+                                            unsigned LineKind,
+                                            UnitQueue &Queue) const {
+  auto IsChange = false;
+  std::array<Mask, MaxSquares> LinesOfValue;
+  for (auto Unit = 0u; Unit < NumSquares; ++Unit) {
+    auto Cells = getUnitCells(Kind, Unit);
+    std::fill_n(LinesOfValue.begin(), NumSquares, 0);
+    for (auto Cell : Cells)
+      for (auto Vals = getPossibleValues(Brd, Cell); Vals;
+           clearLowestBit(Vals))
+        LinesOfValue[getLowestBit(Vals)] |=
+            getBit<Mask>(CellUnits[Cell][LineKind]);
+
+    for (auto Val = 0u; Val < NumSquares; ++Val) {
+      if (countBits(LinesOfValue[Val]) != 1)
+        continue;
+      // The value of the unit is in this line, so not elsewhere in it
+      auto Line = getLowestBit(LinesOfValue[Val]);
+      for (auto Cell : getUnitCells(LineKind, Line))
+        if (CellUnits[Cell][Kind] != Unit)
+          IsChange |= excludeValues(Brd, Cell, getBit<Mask>(Val), Queue);
+    }
+  }
+  return IsChange;
+}
+
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::excludeNakedSubsets(Board &Brd, unsigned Size,
+                                                  UnitQueue &Queue) const {
+  auto IsChange = false;
+  std::array<Mask, MaxSquares> ValuesOfCell;
+  for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+    for (auto Unit = 0u; Unit < NumSquares; ++Unit) {
+      auto Cells = getUnitCells(Kind, Unit);
+      for (auto Idx = 0u; Idx < NumSquares; ++Idx)
+        ValuesOfCell[Idx] = getPossibleValues(Brd, Cells[Idx]);
+      IsChange |= forEachSubset(
+          ValuesOfCell.data(), NumSquares, Size,
+          [&](Mask Subset, Mask Values) {
+            auto IsExcluded = false;
+            for (auto Idx = 0u; Idx < NumSquares; ++Idx)
+              if (!hasBit(Subset, Idx))
+                IsExcluded |= excludeValues(Brd, Cells[Idx], Values, Queue);
+            return IsExcluded;
+          });
+    }
+  return IsChange;
+}
+
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::excludeHiddenSubsets(Board &Brd, unsigned Size,
+                                                   UnitQueue &Queue) const {
+  auto IsChange = false;
+  std::array<Mask, MaxSquares> CellsOfValue;
+  for (auto Kind = 0u; Kind < COUNT_UNIT_KINDS; ++Kind)
+    for (auto Unit = 0u; Unit < NumSquares; ++Unit) {
+      auto Cells = getUnitCells(Kind, Unit);
+      std::fill_n(CellsOfValue.begin(), NumSquares, 0);
+      for (auto Idx = 0u; Idx < NumSquares; ++Idx)
+        for (auto Vals = getPossibleValues(Brd, Cells[Idx]); Vals;
+             clearLowestBit(Vals))
+          CellsOfValue[getLowestBit(Vals)] |= getBit<Mask>(Idx);
+      IsChange |= forEachSubset(
+          CellsOfValue.data(), NumSquares, Size,
+          [&](Mask Values, Mask Subset) {
+            auto IsExcluded = false;
+            for (; Subset; clearLowestBit(Subset))
+              IsExcluded |= excludeValues(Brd, Cells[getLowestBit(Subset)],
+                                          AllValues & ~Values, Queue);
+            return IsExcluded;
+          });
+    }
+  return IsChange;
+}
+
+// The cell Idx of a row is in the column Idx and vice versa, so the
+// positions of a value in the base lines are indices of the cover lines.
+template <unsigned MaxSquares>
+bool SizedSolver<MaxSquares>::excludeFish(Board &Brd, unsigned BaseKind,
+                                          unsigned CoverKind, unsigned Size,
+                                          UnitQueue &Queue) const {
+  auto IsChange = false;
+  std::array<Mask, MaxSquares> CoversOfBase;
+  for (auto Val = 0u; Val < NumSquares; ++Val) {
+    auto Bit = getBit<Mask>(Val);
+    for (auto Base = 0u; Base < NumSquares; ++Base) {
+      auto Cells = getUnitCells(BaseKind, Base);
+      CoversOfBase[Base] = 0;
+      for (auto Idx = 0u; Idx < NumSquares; ++Idx)
+        if (getPossibleValues(Brd, Cells[Idx]) & Bit)
+          CoversOfBase[Base] |= getBit<Mask>(Idx);
+    }
+    IsChange |= forEachSubset(
+        CoversOfBase.data(), NumSquares, Size, [&](Mask Bases, Mask Covers) {
+          auto IsExcluded = false;
+          for (; Covers; clearLowestBit(Covers)) {
+            auto Cells = getUnitCells(CoverKind, getLowestBit(Covers));
+            for (auto Idx = 0u; Idx < NumSquares; ++Idx)
+              if (!hasBit(Bases, Idx))
+                IsExcluded |= excludeValues(Brd, Cells[Idx], Bit, Queue);
+          }
+          return IsExcluded;
+        });
+  }
+  return IsChange;
+}
+
+#define INSTANTIATE_STRATEGIES(Size)                                           \
+  template void SizedSolver<Size>::setStrategies(                              \
+      const std::vector<Strategy> &);                                          \
+  template bool SizedSolver<Size>::deduce(Board &, UnitQueue &, double)        \
+      const;
+SOLVER_SIZES(INSTANTIATE_STRATEGIES)
+#undef INSTANTIATE_STRATEGIES
+
+} // namespace SudokuGame
@@ -2,11 +2,11 @@
 
 #include "json.hpp"
 #include "Sudoku.h"
+#include "SudokuBatch.h"
 
 namespace SudokuGame {
 
 unsigned ThreadCount;
-bool SolutionFound = false;
 
 std::vector<int> readJsonFile(const std::string &FileName) {
   std::ifstream File(FileName);
@@ -23,35 +23,117 @@ std::vector<int> readJsonFile(const std::string &FileName) {
   return JsonData["sudoku"];
 }
 
+// Solves the puzzles of a file in the batch mode. The solutions are
+// written to the file SolutionsFile or, without it, to the standard
+// output and the report to the standard error.
+void solveBatchFile(const std::string &PuzzlesFile,
+                    const std::string *SolutionsFile,
+                    const SolverOptions &Options) {
+  std::ifstream In(PuzzlesFile);
+  if (!In.is_open())
+    failWithError("Ошибка при открытии файла " + PuzzlesFile);
+  std::ofstream OutFile;
+  if (SolutionsFile) {
+    OutFile.open(*SolutionsFile);
+    if (!OutFile.is_open())
+      failWithError("Ошибка при открытии файла " + *SolutionsFile);
+  }
+
+  auto Report = solveBatch(In, SolutionsFile ? OutFile : std::cout, Options);
+  Report.print(SolutionsFile ? std::cout : std::cerr);
+}
+
 } // namespace SudokuGame
 
 int main(int Argc, const char **Argv) {
-  if (Argc < 3) {
-    std::cout << "Usage: ./sudokuSolver <ThreadsCount> <SudokuFile>\n";
+  // Options "--name=value" may go anywhere after the count of threads
+  SudokuGame::SolverOptions Options;
+  std::vector<std::string> Args;
+  for (auto Idx = 1; Idx < Argc; ++Idx) {
+    std::string Arg = Argv[Idx];
+    if (Arg.rfind("--strategies=", 0) == 0)
+      Options.Strategies = Arg.substr(13);
+    else if (Arg.rfind("--engine=", 0) == 0)
+      Options.Engine = Arg.substr(9);
+    else if (Arg.rfind("--search-cost=", 0) == 0)
+      Options.SearchCost = std::stoul(Arg.substr(14));
+    else if (Arg.rfind("--branching=", 0) == 0)
+      Options.Branching = Arg.substr(12);
+    else if (Arg.rfind("--max-seconds=", 0) == 0)
+      Options.MaxSeconds = std::stod(Arg.substr(14));
+    else
+      Args.push_back(Arg);
+  }
+
+  if (Args.size() < 2) {
+    std::cout << "Usage: ./sudokuSolver <ThreadsCount> <SudokuFile> "
+                 "[--count [<Limit>] | --unique]\n"
+              << "       ./sudokuSolver <ThreadsCount> --batch <PuzzlesFile> "
+                 "[<SolutionsFile>]\n"
+              << "Options: --strategies=<all | none | name,name...> "
+                 "--search-cost=<ChecksPerCell>\n"
+              << "         --engine=<auto | backtracking | dlx> "
+                 "--branching=<all | none | buckets,degree,lcv>\n"
+              << "         --max-seconds=<Seconds, 0 for no limit>\n";
     exit(EXIT_SUCCESS);
   }
   try {
-    auto SudokuArray = SudokuGame::readJsonFile(Argv[2]);
-    SudokuGame::SudokuSolver Sudoku(SudokuArray);
+    SudokuGame::ThreadCount = std::stoi(Args[0]);
+    if (SudokuGame::ThreadCount <= 0)
+      SudokuGame::failWithError("Thread Count should be positive\n");
+    omp_set_num_threads(SudokuGame::ThreadCount);
+
+    if (Args[1] == "--batch") {
+      if (Args.size() < 3)
+        SudokuGame::failWithError("Нет файла с судоку для --batch");
+      SudokuGame::solveBatchFile(Args[2], Args.size() > 3 ? &Args[3] : nullptr,
+                                 Options);
+      return 0;
+    }
+
+    auto SudokuArray = SudokuGame::readJsonFile(Args[1]);
+    // The solver compiled for the size of the sudoku
+    std::unique_ptr<SudokuGame::SudokuSolver> Sudoku;
+    SudokuGame::loadSolver(Sudoku, SudokuArray, Options);
 
     std::cout << "Начальное судоку:\n\n";
-    Sudoku.print();
+    Sudoku->print();
 
     std::cout << "\n\n";
 
-    SudokuGame::ThreadCount = atoi(Argv[1]);
-    if (SudokuGame::ThreadCount <= 0)
-      SudokuGame::failWithError("Thread Count should be positive\n");
-    omp_set_num_threads(SudokuGame::ThreadCount);
-
     auto Start = omp_get_wtime();
 
-    if (Sudoku.solve()) {
+    std::string Mode = Args.size() > 2 ? Args[2] : "";
+    if (Mode == "--count" || Mode == "--unique") {
+      // Enumeration of all the solutions or of the first Limit of them
+      size_t Limit = Mode == "--unique" ? 2 : 0;
+      if (Mode == "--count" && Args.size() > 3)
+        Limit = std::stoull(Args[3]);
+      auto Count = Sudoku->countSolutions(Limit);
+      auto End = omp_get_wtime();
+      if (Sudoku->hasGivenUp() && (Mode == "--count" || Count < 2))
+        std::cout << (Mode == "--unique"
+                          ? "Перебор остановлен по --max-seconds, "
+                            "единственность не проверена\n"
+                          : "Перебор остановлен по --max-seconds, решений "
+                            "не меньше " + std::to_string(Count) + "\n");
+      else if (Mode == "--unique")
+        std::cout << (Count == 0   ? "Решение судоку невозможно!\n"
+                      : Count == 1 ? "Решение единственно\n"
+                                   : "Решение не единственно\n");
+      else if (Limit && Count == Limit)
+        std::cout << "Решений не меньше " << Count << "\n";
+      else
+        std::cout << "Решений: " << Count << "\n";
+      std::cout << "\nTime: " << End - Start << "\n";
+    } else if (Sudoku->solve()) {
       auto End = omp_get_wtime();
       std::cout << "Решение:\n\n";
-      Sudoku.printSolved();
+      Sudoku->printSolved();
       std::cout << "\n\nTime: " << End - Start << "\n";
-    } else
+    } else if (Sudoku->hasGivenUp())
+      std::cout << "Решение не найдено: перебор остановлен по --max-seconds\n";
+    else
       std::cout << "Решение судоку невозможно!\n";
   } catch (const std::exception &Ex) {
     std::cerr << Ex.what() << "\n";